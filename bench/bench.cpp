@@ -0,0 +1,236 @@
+/*
+Benchmark suite of both practices: workload generators and scaling curves.
+Regexpr engines of practice1 (RegexprParser::GetMaxSubwordLength) and recognizers of practice2
+(Algo::IsDeducible, CYK::IsDeducible) are run on inputs of growing length n.
+Every measurement is printed as one JSON line:
+{"engine": ..., "workload": ..., "m": ..., "n": ..., "ms": ..., "allocations": ..., "peak_bytes": ..., "answer": ...}
+m is the regexpr length (0 for grammars), ms is the best of several runs for fast ones,
+allocations and peak_bytes (peak of live heap memory above the level before the run)
+are counted by operator new. A curve stops once a run takes longer than kMaxMs
+or its live heap grows over kMaxPeakBytes.
+
+g++ -std=c++17 -O2 -pthread bench.cpp && ./a.out [filter] > results.jsonl
+filter keeps only curves whose "engine/workload" contains it.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include "../practice1/lib/regexpr_parser.h"
+#include "../practice2/lib/CYK.cpp"
+
+std::atomic<long long> allocations_num(0);
+std::atomic<size_t> live_bytes(0);
+std::atomic<size_t> peak_bytes(0);
+
+struct alignas(std::max_align_t) AllocationHeader {
+    size_t size;
+};
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    auto header = static_cast<AllocationHeader*>(std::malloc(sizeof(AllocationHeader) + size));
+    if (header == nullptr) {
+        throw std::bad_alloc();
+    }
+    header->size = size;
+    ++allocations_num;
+    size_t live = (live_bytes += size);
+    size_t peak = peak_bytes;
+    while (live > peak && !peak_bytes.compare_exchange_weak(peak, live)) {
+    }
+    return header + 1;
+}
+
+__attribute__((noinline)) void operator delete(void* pointer) noexcept {
+    if (pointer != nullptr) {
+        auto header = static_cast<AllocationHeader*>(pointer) - 1;
+        live_bytes -= header->size;
+        std::free(header);
+    }
+}
+
+__attribute__((noinline)) void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+struct Measurement {
+    double ms;
+    long long allocations;
+    size_t peak_bytes;
+    long long answer;
+};
+
+Measurement Measure(const std::function<long long()>& run) {
+
+    // fast runs are repeated, the best time is taken; counters are the same every time
+    const double kRepeatMs = 50;
+    const int kRepeatsNum = 5;
+
+    Measurement best = {0, 0, 0, 0};
+    for (int repeat = 0; repeat < kRepeatsNum; ++repeat) {
+        long long allocations_before = allocations_num;
+        size_t live_before = live_bytes;
+        peak_bytes = live_before;
+        auto begin = std::chrono::steady_clock::now();
+        long long answer = run();
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+        if (repeat == 0 || ms < best.ms) {
+            best = {ms, allocations_num - allocations_before, peak_bytes - live_before, answer};
+        }
+        if (ms > kRepeatMs) {
+            break;
+        }
+    }
+    return best;
+
+}
+
+void RunCurve(const std::string& filter, const std::string& engine, const std::string& workload, int m,
+              const std::function<std::string(int)>& generate, const std::function<long long(const std::string&)>& run) {
+
+    // n = 64, 128, ..., while runs are fast enough; words are generated before measuring
+    const int kMinLength = 64;
+    const int kMaxLength = 1 << 20;
+    const double kMaxMs = 2000;
+    const size_t kMaxPeakBytes = size_t(1) << 29;
+
+    if ((engine + "/" + workload).find(filter) == std::string::npos) {
+        return;
+    }
+    for (int length = kMinLength; length <= kMaxLength; length *= 2) {
+        const std::string word = generate(length);
+        Measurement measurement = Measure([&run, &word] { return run(word); });
+        std::cout << "{\"engine\": \"" << engine << "\", \"workload\": \"" << workload
+            << "\", \"m\": " << m << ", \"n\": " << length << ", \"ms\": " << measurement.ms
+            << ", \"allocations\": " << measurement.allocations << ", \"peak_bytes\": " << measurement.peak_bytes
+            << ", \"answer\": " << measurement.answer << "}" << std::endl;
+        if (measurement.ms > kMaxMs || measurement.peak_bytes > kMaxPeakBytes) {
+            break;
+        }
+    }
+
+}
+
+std::string RandomRegexpr(int size, std::mt19937& generator) {
+
+    // postfix regexpr of exactly size symbols over {a, b, c}:
+    // letters and 1 are leaves, * takes one operand, + and . take two
+
+    if (size == 1) {
+        return std::string(1, "aabbcc1"[generator() % 7]);
+    }
+    if (size == 2 || generator() % 6 == 0) {
+        return RandomRegexpr(size - 1, generator) + "*";
+    }
+    int lhs_size = 1 + generator() % (size - 2);
+    std::string lhs = RandomRegexpr(lhs_size, generator);
+    return lhs + RandomRegexpr(size - 1 - lhs_size, generator) + ".+"[generator() % 2];
+
+}
+
+std::string RandomWord(int length, const std::string& letters, std::mt19937& generator) {
+    std::string word;
+    for (int i = 0; i < length; ++i) {
+        word.push_back(letters[generator() % letters.length()]);
+    }
+    return word;
+}
+
+std::string RandomDyckWord(int length, std::mt19937& generator) {
+
+    // balanced brackets of even length: '(' while there is room to close everything
+    std::string word;
+    int open = 0;
+    for (int i = 0; i < length; ++i) {
+        bool can_open = open < length - i - 1;
+        if (can_open && (open == 0 || generator() % 2 == 0)) {
+            word.push_back('(');
+            ++open;
+        } else {
+            word.push_back(')');
+            --open;
+        }
+    }
+    return word;
+
+}
+
+void BenchRegexpr(const std::string& filter) {
+
+    const std::vector<std::pair<std::string, RegexprParser::Engine>> engines = {
+        {"regex-matrix", RegexprParser::Engine::kMatrix},
+        {"regex-automaton", RegexprParser::Engine::kAutomaton},
+        {"regex-bands", RegexprParser::Engine::kBands}
+    };
+    auto random_word = [](int length) {
+        std::mt19937 generator(length);
+        return RandomWord(length, "abc", generator);
+    };
+    for (int regexpr_size : {16, 64}) {
+        std::mt19937 generator(regexpr_size);
+        std::string regexpr = RandomRegexpr(regexpr_size, generator);
+        for (const auto& engine : engines) {
+            RunCurve(filter, engine.first, "random", regexpr_size, random_word, [&](const std::string& word) {
+                RegexprParser parser(regexpr, word);
+                parser.SetEngine(engine.second);
+                return parser.GetMaxSubwordLength();
+            });
+        }
+    }
+
+}
+
+void BenchGrammars(const std::string& filter) {
+
+    struct Workload {
+        std::string name;
+        Grammar grammar;
+        std::function<std::string(int)> word;
+    };
+    std::vector<Workload> workloads = {
+        {"dyck", Grammar({GrammarRule('S', "(S)S"), GrammarRule('S', "")}, 'S'), [](int length) {
+            std::mt19937 generator(length);
+            return RandomDyckWord(length, generator);
+        }},
+        {"ambiguous", Grammar({GrammarRule('S', "SS"), GrammarRule('S', "a")}, 'S'), [](int length) {
+            return std::string(length, 'a');
+        }},
+        {"right-recursive", Grammar({GrammarRule('S', "aS"), GrammarRule('S', "a")}, 'S'), [](int length) {
+            return std::string(length, 'a');
+        }}
+    };
+
+    for (const auto& workload : workloads) {
+        Algo earley(workload.grammar);
+        Algo classic(workload.grammar);
+        classic.SetLeoOptimization(false);
+        CYK valiant(workload.grammar);
+        valiant.SetMode(CYK::Mode::kValiant);
+        RunCurve(filter, "earley", workload.name, 0, workload.word, [&](const std::string& word) {
+            return earley.IsDeducible(word);
+        });
+        RunCurve(filter, "earley-classic", workload.name, 0, workload.word, [&](const std::string& word) {
+            return classic.IsDeducible(word);
+        });
+        RunCurve(filter, "cyk-valiant", workload.name, 0, workload.word, [&](const std::string& word) {
+            return valiant.IsDeducible(word);
+        });
+    }
+
+}
+
+int main(int argc, char** argv) {
+
+    std::string filter = (argc > 1 ? argv[1] : "");
+    BenchRegexpr(filter);
+    BenchGrammars(filter);
+    return 0;
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <string>
+
+class Alphabet {
+    /*
+    Symbols that can be used in words and as regexpr letters: a lookup table over all 256 bytes,
+    so any bytes can be letters, {a, b, c} by default.
+    Operator symbols 1, *, + and . are never letters.
+    */
+public:
+    constexpr Alphabet() : Alphabet("abc") {}
+    constexpr explicit Alphabet(const char* symbols);
+    explicit Alphabet(const std::string& symbols);  // may contain any bytes, '\0' too
+    constexpr bool Contains(char symbol) const { return letters_[static_cast<unsigned char>(symbol)]; }
+private:
+    static constexpr bool IsOperator(char symbol) {
+        return symbol == '1' || symbol == '*' || symbol == '+' || symbol == '.';
+    }
+    std::array<bool, 256> letters_{};
+};
+
+constexpr Alphabet::Alphabet(const char* symbols) {
+    for (; *symbols != 0; ++symbols) {
+        letters_[static_cast<unsigned char>(*symbols)] = !IsOperator(*symbols);
+    }
+}
+
+Alphabet::Alphabet(const std::string& symbols) {
+    for (char symbol : symbols) {
+        letters_[static_cast<unsigned char>(symbol)] = !IsOperator(symbol);
+    }
+}
@@ -0,0 +1,434 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "alphabet.h"
+#include "occurrences.h"
+#include "result.h"
+#include "thread_pool.h"
+
+class CompiledRegex {
+    /*
+    Regexpr in reverse polish notation, parsed and validated once.
+    It is stored as an immutable operator DAG (nodes in postfix order, children before parents),
+    so evaluating it for a word doesn't re-check the regexpr.
+    Equal subexpressions (e.g. every ab. of the regexpr) are one node, so they are evaluated once per word.
+    Every node computes only the relations its parents need (e.g. the lhs of a concatenation
+    under the root needs no prefixes), the others stay empty matrices.
+    Evaluate is const and uses only local memory: one CompiledRegex can be shared between threads.
+    */
+public:
+    explicit CompiledRegex(const std::string& regexpr, const Alphabet& alphabet = Alphabet());
+    bool IsValid() const;
+    int Evaluate(const std::string& word) const;
+    int Evaluate(const std::string& word, ThreadPool& pool) const;
+    std::vector<int> EvaluateAll(const std::vector<std::string>& words, int threads_num = 0) const;
+    std::string GetParsedRegexpr() const;
+    int NodesNum() const;  // different subexpressions of the regexpr
+    int Relations(int node_index) const;  // Result::Relation mask the node computes
+    int MaxWordLength() const;  // of the words of the language, -1 if they are unbounded
+    static const int ERROR = -1;
+    static const int INF = -2;
+    class Evaluator;
+private:
+    friend class IncrementalRegex;
+    struct Node {
+        char symbol;
+        int lhs;  // index of the first operand, -1 for leaves
+        int rhs;  // index of the second operand, -1 for leaves and '*'
+    };
+    // regexpr is valid and word is over the alphabet, occurrences of its symbols are found
+    bool CheckWord(const std::string& word, Occurrences& occurrences) const;
+    static int MaxLength(const Node& node, const std::vector<int>& max_lengths);
+    Result EvaluateSubtree(int node_index, const Occurrences& occurrences, ThreadPool& pool) const;
+    std::string GetParsedSubtree(int node_index) const;
+    std::vector<Node> nodes_;  // empty if the regexpr is incorrect
+    std::vector<int> uses_;  // by node: operands of other nodes it is, 1 for the root
+    std::vector<int> relations_;  // by node: Result::Relation mask of relations it computes
+    int max_word_length_ = -1;  // upper bound of the answer for any word, -1 if there is none
+    Alphabet alphabet_;
+};
+
+class CompiledRegex::Evaluator {
+    /*
+    Scratch memory for evaluating one word at a time.
+    Each thread uses its own Evaluator. Once it has evaluated a word,
+    words of the same or smaller length (with no more different symbols) are evaluated without allocating memory.
+    The Result of a node is kept until its last parent is evaluated, then its matrices go back to the pool.
+    Leaves are shared by almost every node, keeping them would keep their matrices for the whole evaluation,
+    so a leaf is evaluated again for every parent, it takes only O(n^2 / 128).
+    */
+public:
+    explicit Evaluator(const CompiledRegex& regex) : regex_(regex) {}
+    int Evaluate(const std::string& word);
+    // the longest subword not longer than max_length, matrices keep only such subwords: O(n * max_length) memory
+    int Evaluate(const std::string& word, int max_length);
+    // whether a subword of length >= min_length fits the regexpr (false for incorrect input too)
+    bool HasSubword(const std::string& word, int min_length);
+    // the same answer as Evaluate(word), bands of doubling width until the answer is shorter than the band
+    int EvaluateByBands(const std::string& word);
+    static const int kFirstBand = 64;
+private:
+    int EvaluateBand(int band);  // for the word of occurrences_, -1 - no band
+    // Result of node, a leaf is evaluated into leaf
+    const Result& Operand(int node_index, std::optional<Result>& leaf);
+    void Use(int node_index, std::optional<Result>& leaf);  // one more parent of node has been evaluated
+    const CompiledRegex& regex_;
+    std::vector<Result> results_;  // of inner nodes that are still needed
+    std::vector<int> result_indexes_;  // by node, index in results_, -1 for leaves
+    std::vector<int> uses_left_;  // by node
+    int band_ = -1;  // of the current evaluation
+    Occurrences occurrences_;
+    MatrixPool pool_;  // up to 4 matrices for every Result that is still needed, reused for every word
+};
+
+CompiledRegex::CompiledRegex(const std::string& regexpr, const Alphabet& alphabet) : alphabet_(alphabet) {
+
+    // O(m)
+    // Nodes are hash-consed: a node with the same symbol and operands as an existing one isn't added,
+    // the existing one is used instead. Operands are unique already, so equal subexpressions become one node.
+
+    std::vector<int> operands;  // stack of node indexes
+    std::unordered_map<uint64_t, int> node_indexes;  // by symbol and operand indexes
+    std::vector<int> max_lengths;  // by node: longest word of its language, -1 if unbounded
+
+    for (char symbol : regexpr) {
+        Node node = {symbol, -1, -1};
+        if (symbol == '*') {
+            if (operands.empty()) {
+                // requires 1 argument
+                nodes_.clear();
+                return;
+            }
+            node.lhs = operands.back();
+            operands.pop_back();
+        } else if (symbol == '+' || symbol == '.') {
+            if (operands.size() < 2) {
+                // requires 2 arguments
+                nodes_.clear();
+                return;
+            }
+            node.rhs = operands.back();
+            operands.pop_back();
+            node.lhs = operands.back();
+            operands.pop_back();
+        } else if (symbol != '1' && !alphabet_.Contains(symbol)) {
+            // regexpr is incorrect
+            nodes_.clear();
+            return;
+        }
+        uint64_t key = uint64_t(static_cast<unsigned char>(node.symbol)) << 56
+            | uint64_t(node.lhs + 1) << 28 | uint64_t(node.rhs + 1);
+        auto inserted = node_indexes.emplace(key, nodes_.size());
+        if (inserted.second) {
+            nodes_.push_back(node);
+            uses_.push_back(0);
+            max_lengths.push_back(MaxLength(node, max_lengths));
+            if (node.lhs != -1) {
+                ++uses_[node.lhs];
+            }
+            if (node.rhs != -1) {
+                ++uses_[node.rhs];
+            }
+        }
+        operands.push_back(inserted.first->second);
+    }
+
+    if (operands.size() != 1) {
+        // empty regexpr or some parts haven't been combined
+        nodes_.clear();
+        uses_.clear();
+        return;
+    }
+    // the whole regexpr is bigger than any other subexpression, so its node is the last one
+    ++uses_.back();
+    max_word_length_ = max_lengths.back();
+
+    // demand analysis: the answer needs only subwords of the root, parents come after their operands,
+    // so going backwards every node has got the demands of all its parents before it is handled
+    relations_.assign(nodes_.size(), 0);
+    relations_.back() = Result::kSubword;
+    for (int i = nodes_.size() - 1; i >= 0; --i) {
+        const Node& node = nodes_[i];
+        relations_[i] = Result::ComputedRelations(node.symbol, relations_[i]);
+        if (node.lhs != -1) {
+            relations_[node.lhs] |= Result::LhsRelations(node.symbol, relations_[i]);
+        }
+        if (node.rhs != -1) {
+            relations_[node.rhs] |= Result::RhsRelations(node.symbol, relations_[i]);
+        }
+    }
+
+}
+
+bool CompiledRegex::IsValid() const {
+    return !nodes_.empty();
+}
+
+int CompiledRegex::NodesNum() const {
+    return nodes_.size();
+}
+
+int CompiledRegex::Relations(int node_index) const {
+    return relations_[node_index];
+}
+
+int CompiledRegex::MaxWordLength() const {
+    return max_word_length_;
+}
+
+int CompiledRegex::MaxLength(const Node& node, const std::vector<int>& max_lengths) {
+    // operands are added before the node, -1 stands for unbounded length
+    if (node.symbol == '1') {
+        return 0;
+    } else if (node.lhs == -1) {
+        return 1;
+    } else if (node.symbol == '*') {
+        return max_lengths[node.lhs] == 0 ? 0 : -1;
+    }
+    int lhs = max_lengths[node.lhs];
+    int rhs = max_lengths[node.rhs];
+    if (lhs == -1 || rhs == -1) {
+        return -1;
+    }
+    return node.symbol == '+' ? std::max(lhs, rhs) : lhs + rhs;
+}
+
+int CompiledRegex::Evaluate(const std::string& word) const {
+    return Evaluator(*this).Evaluate(word);
+}
+
+int CompiledRegex::Evaluate(const std::string& word, ThreadPool& pool) const {
+
+    // O(m * n^3 / 64) work, operands of '+' and '.' are evaluated in parallel;
+    // tasks don't wait for each other, so a shared node is evaluated for each of its parents here
+
+    Occurrences occurrences;
+    if (!CheckWord(word, occurrences)) {
+        return ERROR;
+    }
+
+    Result result = EvaluateSubtree(nodes_.size() - 1, occurrences, pool);
+    return result.subword_indexes.MaxDistance();
+
+}
+
+Result CompiledRegex::EvaluateSubtree(int node_index, const Occurrences& occurrences, ThreadPool& pool) const {
+
+    const Node& node = nodes_[node_index];
+    int length = occurrences.Length();
+    Result current_result(std::string(), length, relations_[node_index]);
+
+    if (node.symbol == '1') {
+        current_result.AddEpsilon(length);
+    } else if (node.symbol == '*') {
+        current_result.AddStar(EvaluateSubtree(node.lhs, occurrences, pool));
+    } else if (node.symbol == '+' || node.symbol == '.') {
+        // lhs is forked as a task (unless it is a single letter), rhs is evaluated here, then they are joined;
+        // while waiting this thread runs other tasks, e.g. subtasks of rhs stolen by nobody
+        Result lhs(std::string(), 0);  // replaced by the evaluated operand
+        std::atomic<int> pending(0);
+        if (nodes_[node.lhs].lhs == -1) {
+            lhs = EvaluateSubtree(node.lhs, occurrences, pool);
+        } else {
+            pending = 1;
+            pool.Submit([this, &lhs, &pending, &occurrences, &pool, &node] {
+                lhs = EvaluateSubtree(node.lhs, occurrences, pool);
+                --pending;
+            });
+        }
+        Result rhs = EvaluateSubtree(node.rhs, occurrences, pool);
+        pool.WaitFor(pending);
+        if (node.symbol == '+') {
+            current_result.AddPlus(lhs, rhs);
+        } else {
+            current_result.AddConcat(lhs, rhs);
+        }
+    } else {
+        current_result.AddSymbol(occurrences, node.symbol);
+    }
+
+    return current_result;
+
+}
+
+bool CompiledRegex::CheckWord(const std::string& word, Occurrences& occurrences) const {
+
+    // O(n)
+
+    return IsValid() && occurrences.Reset(word, alphabet_);
+
+}
+
+std::string CompiledRegex::GetParsedRegexpr() const {
+    return IsValid() ? GetParsedSubtree(nodes_.size() - 1) : std::string();
+}
+
+std::string CompiledRegex::GetParsedSubtree(int node_index) const {
+    // same format as RegexprParser::GetParsedRegexpr
+    const Node& node = nodes_[node_index];
+    if (node.symbol == '*') {
+        return GetParsedSubtree(node.lhs) + '*';
+    } else if (node.symbol == '+') {
+        return '(' + GetParsedSubtree(node.lhs) + '+' + GetParsedSubtree(node.rhs) + ')';
+    } else if (node.symbol == '.') {
+        return '(' + GetParsedSubtree(node.lhs) + GetParsedSubtree(node.rhs) + ')';
+    }
+    return std::string(1, node.symbol);
+}
+
+std::vector<int> CompiledRegex::EvaluateAll(const std::vector<std::string>& words, int threads_num) const {
+
+    // words are handed out to the workers one by one, every worker keeps its own Evaluator
+
+    std::vector<int> answers(words.size());
+    std::atomic<size_t> next_word(0);
+    ThreadPool pool(threads_num);
+
+    for (int i = 0; i < pool.Size(); ++i) {
+        pool.Submit([this, &words, &answers, &next_word] {
+            Evaluator evaluator(*this);
+            for (size_t index = next_word++; index < words.size(); index = next_word++) {
+                answers[index] = evaluator.Evaluate(words[index]);
+            }
+        });
+    }
+    pool.Wait();
+
+    return answers;
+
+}
+
+int CompiledRegex::Evaluator::Evaluate(const std::string& word) {
+
+    // O(m * n^3 / 64), O(m * n * w^2 / 64) if the words of the language are not longer than w
+
+    if (!regex_.CheckWord(word, occurrences_)) {
+        return ERROR;
+    }
+    // no subword is longer than the longest word, so the band loses nothing
+    return EvaluateBand(regex_.max_word_length_);
+
+}
+
+int CompiledRegex::Evaluator::Evaluate(const std::string& word, int max_length) {
+
+    // O(m * n * w^2 / 64), w = max_length
+
+    if (!regex_.CheckWord(word, occurrences_)) {
+        return ERROR;
+    }
+    if (regex_.max_word_length_ != -1) {
+        max_length = std::min(max_length, regex_.max_word_length_);
+    }
+    return EvaluateBand(std::max(max_length, 0));
+
+}
+
+bool CompiledRegex::Evaluator::HasSubword(const std::string& word, int min_length) {
+
+    // O(m * n * w^2 / 64), w = min_length
+    // subwords of a fitting subword fit too, so a longer one contains one of length exactly min_length
+
+    if (min_length > static_cast<int>(word.length())) {
+        return false;
+    }
+    return Evaluate(word, min_length) >= std::max(min_length, 0);
+
+}
+
+int CompiledRegex::Evaluator::EvaluateByBands(const std::string& word) {
+
+    // O(m * n * A^2 / 64), A - the answer: the last band is less than 2 * A (or the upper bound),
+    // the previous ones take less time together
+
+    if (!regex_.CheckWord(word, occurrences_)) {
+        return ERROR;
+    }
+    int upper_bound = word.length();
+    if (regex_.max_word_length_ != -1) {
+        upper_bound = std::min(upper_bound, regex_.max_word_length_);
+    }
+    for (int band = kFirstBand; band < upper_bound; band *= 2) {
+        int max_subword_length = EvaluateBand(band);
+        if (max_subword_length < band) {
+            // proven: a longer subword would contain a fitting subword of length band
+            return max_subword_length;
+        }
+    }
+    return EvaluateBand(upper_bound);
+
+}
+
+int CompiledRegex::Evaluator::EvaluateBand(int band) {
+
+    int length = occurrences_.Length();
+    band_ = band;
+    results_.clear();
+    result_indexes_.assign(regex_.nodes_.size(), -1);
+    uses_left_ = regex_.uses_;
+
+    // nodes are stored in postfix order, so operands are always evaluated before their parents
+    for (size_t i = 0; i < regex_.nodes_.size(); ++i) {
+        const Node& node = regex_.nodes_[i];
+        if (node.lhs == -1) {
+            continue;  // leaves are evaluated by their parents
+        }
+        Result current_result(std::string(), pool_, length, regex_.relations_[i], band_);
+        std::optional<Result> lhs_leaf;
+        const Result& lhs = Operand(node.lhs, lhs_leaf);
+        if (node.symbol == '*') {
+            current_result.AddStar(lhs);
+        } else {
+            std::optional<Result> rhs_leaf;
+            const Result& rhs = Operand(node.rhs, rhs_leaf);
+            if (node.symbol == '+') {
+                current_result.AddPlus(lhs, rhs);
+            } else {
+                current_result.AddConcat(lhs, rhs);
+            }
+            Use(node.rhs, rhs_leaf);
+        }
+        Use(node.lhs, lhs_leaf);
+        result_indexes_[i] = results_.size();
+        results_.push_back(std::move(current_result));
+    }
+
+    std::optional<Result> root_leaf;
+    int root = regex_.nodes_.size() - 1;
+    int max_subword_length = Operand(root, root_leaf).subword_indexes.MaxDistance();
+    Use(root, root_leaf);
+    return max_subword_length;
+
+}
+
+const Result& CompiledRegex::Evaluator::Operand(int node_index, std::optional<Result>& leaf) {
+
+    // O(n^2 / 128) for a leaf: up to 4 cleared matrices, O(n / 64) to fill them
+
+    const Node& node = regex_.nodes_[node_index];
+    if (node.lhs != -1) {
+        return results_[result_indexes_[node_index]];
+    }
+    leaf.emplace(std::string(), pool_, occurrences_.Length(), regex_.relations_[node_index], band_);
+    if (node.symbol == '1') {
+        leaf->AddEpsilon(occurrences_.Length());
+    } else {
+        leaf->AddSymbol(occurrences_, node.symbol);
+    }
+    return *leaf;
+
+}
+
+void CompiledRegex::Evaluator::Use(int node_index, std::optional<Result>& leaf) {
+    if (leaf) {
+        leaf->Release(pool_);
+    } else if (--uses_left_[node_index] == 0) {
+        results_[result_indexes_[node_index]].Release(pool_);
+    }
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <string>
+#include <utility>
+#include <vector>
+#include "alphabet.h"
+#include "compiled_regex.h"
+
+class FactorAutomaton {
+    /*
+    Thompson NFA of a regexpr in reverse polish notation, trimmed to the states
+    that lie on some path from the initial state to the final one.
+    If every state of it is made initial and final, it accepts exactly the subwords
+    of the words of L, so the answer is the longest subword of u accepted by that automaton.
+    */
+public:
+    explicit FactorAutomaton(const std::string& regexpr, const Alphabet& alphabet = Alphabet());
+    bool IsValid() const;
+    int GetMaxSubwordLength(const std::string& word) const;
+private:
+    struct State {
+        char symbol = 0;  // letter of the outgoing transition, 0 if there is none
+        int next = -1;
+        std::vector<int> epsilon;  // targets of epsilon transitions
+    };
+    struct Fragment {
+        int begin;
+        int end;
+    };
+    struct Transition {
+        int from;  // epsilon components
+        int to;
+    };
+    int AddState();
+    void Trim(int initial, int final);
+    void Condense();
+    Alphabet alphabet_;
+    std::vector<State> states_;  // empty if the regexpr is incorrect
+    // states connected by epsilon cycles are equivalent for the search, so they are merged
+    // into components, numbered so that epsilon transitions go from bigger numbers to smaller
+    std::vector<int> component_;
+    std::vector<std::vector<int>> component_epsilon_;
+    std::vector<std::vector<Transition>> transitions_;  // letter transitions between components, by letter
+};
+
+FactorAutomaton::FactorAutomaton(const std::string& regexpr, const Alphabet& alphabet) : alphabet_(alphabet) {
+
+    // O(m)
+
+    std::vector<Fragment> fragments;
+
+    for (char symbol : regexpr) {
+        Fragment fragment = {AddState(), AddState()};
+        if (symbol == '1') {
+            states_[fragment.begin].epsilon.push_back(fragment.end);
+        } else if (symbol == '*') {
+            if (fragments.empty()) {
+                // requires 1 argument
+                states_.clear();
+                return;
+            }
+            Fragment last = fragments.back();
+            fragments.pop_back();
+            states_[fragment.begin].epsilon = {last.begin, fragment.end};
+            states_[last.end].epsilon.push_back(last.begin);
+            states_[last.end].epsilon.push_back(fragment.end);
+        } else if (symbol == '+' || symbol == '.') {
+            if (fragments.size() < 2) {
+                // requires 2 arguments
+                states_.clear();
+                return;
+            }
+            Fragment rhs = fragments.back();
+            fragments.pop_back();
+            Fragment lhs = fragments.back();
+            fragments.pop_back();
+            if (symbol == '+') {
+                states_[fragment.begin].epsilon = {lhs.begin, rhs.begin};
+                states_[lhs.end].epsilon.push_back(fragment.end);
+                states_[rhs.end].epsilon.push_back(fragment.end);
+            } else {
+                states_[fragment.begin].epsilon.push_back(lhs.begin);
+                states_[lhs.end].epsilon.push_back(rhs.begin);
+                states_[rhs.end].epsilon.push_back(fragment.end);
+            }
+        } else if (alphabet_.Contains(symbol)) {
+            states_[fragment.begin].symbol = symbol;
+            states_[fragment.begin].next = fragment.end;
+        } else {
+            // regexpr is incorrect
+            states_.clear();
+            return;
+        }
+        fragments.push_back(fragment);
+    }
+
+    if (fragments.size() != 1) {
+        // empty regexpr or some parts haven't been combined
+        states_.clear();
+        return;
+    }
+
+    Trim(fragments.back().begin, fragments.back().end);
+    Condense();
+
+}
+
+int FactorAutomaton::AddState() {
+    states_.emplace_back();
+    return states_.size() - 1;
+}
+
+bool FactorAutomaton::IsValid() const {
+    return !states_.empty();
+}
+
+void FactorAutomaton::Trim(int initial, int final) {
+
+    // O(m)
+    // keeps states reachable from initial and co-reachable from final
+
+    int states_num = states_.size();
+    std::vector<std::vector<int>> reversed(states_num);
+    for (int i = 0; i < states_num; ++i) {
+        if (states_[i].next != -1) {
+            reversed[states_[i].next].push_back(i);
+        }
+        for (int target : states_[i].epsilon) {
+            reversed[target].push_back(i);
+        }
+    }
+
+    std::vector<bool> reachable(states_num, false);
+    std::vector<int> queue = {initial};
+    reachable[initial] = true;
+    while (!queue.empty()) {
+        const State& state = states_[queue.back()];
+        queue.pop_back();
+        std::vector<int> targets = state.epsilon;
+        if (state.next != -1) {
+            targets.push_back(state.next);
+        }
+        for (int target : targets) {
+            if (!reachable[target]) {
+                reachable[target] = true;
+                queue.push_back(target);
+            }
+        }
+    }
+
+    std::vector<bool> useful(states_num, false);
+    if (reachable[final]) {
+        queue = {final};
+        useful[final] = true;
+    }
+    while (!queue.empty()) {
+        int state = queue.back();
+        queue.pop_back();
+        for (int source : reversed[state]) {
+            if (reachable[source] && !useful[source]) {
+                useful[source] = true;
+                queue.push_back(source);
+            }
+        }
+    }
+
+    // renumbering useful states
+    std::vector<int> new_index(states_num, -1);
+    std::vector<State> trimmed;
+    for (int i = 0; i < states_num; ++i) {
+        if (useful[i]) {
+            new_index[i] = trimmed.size();
+            trimmed.push_back(states_[i]);
+        }
+    }
+    for (State& state : trimmed) {
+        if (state.next != -1) {
+            state.next = new_index[state.next];
+            if (state.next == -1) {
+                state.symbol = 0;
+            }
+        }
+        std::vector<int> epsilon;
+        for (int target : state.epsilon) {
+            if (new_index[target] != -1) {
+                epsilon.push_back(new_index[target]);
+            }
+        }
+        state.epsilon = std::move(epsilon);
+    }
+    states_ = std::move(trimmed);
+
+}
+
+void FactorAutomaton::Condense() {
+
+    // O(m)
+    // Tarjan's strongly connected components of the epsilon graph (iterative).
+    // Components are numbered in the order they are closed, so every epsilon transition
+    // goes from a bigger component number to a smaller or equal one.
+
+    int states_num = states_.size();
+    std::vector<int> order(states_num, -1);
+    std::vector<int> low(states_num, 0);
+    std::vector<bool> on_stack(states_num, false);
+    std::vector<int> stack;
+    std::vector<std::pair<int, size_t>> calls;  // state and index of its next epsilon transition
+    int counter = 0;
+    int components_num = 0;
+    component_.assign(states_num, -1);
+
+    for (int root = 0; root < states_num; ++root) {
+        if (order[root] != -1) {
+            continue;
+        }
+        order[root] = low[root] = counter++;
+        stack.push_back(root);
+        on_stack[root] = true;
+        calls.emplace_back(root, 0);
+        while (!calls.empty()) {
+            int state = calls.back().first;
+            size_t& edge = calls.back().second;
+            if (edge < states_[state].epsilon.size()) {
+                int target = states_[state].epsilon[edge++];
+                if (order[target] == -1) {
+                    order[target] = low[target] = counter++;
+                    stack.push_back(target);
+                    on_stack[target] = true;
+                    calls.emplace_back(target, 0);
+                } else if (on_stack[target]) {
+                    low[state] = std::min(low[state], order[target]);
+                }
+                continue;
+            }
+            calls.pop_back();
+            if (!calls.empty()) {
+                int parent = calls.back().first;
+                low[parent] = std::min(low[parent], low[state]);
+            }
+            if (low[state] == order[state]) {
+                int member = -1;
+                while (member != state) {
+                    member = stack.back();
+                    stack.pop_back();
+                    on_stack[member] = false;
+                    component_[member] = components_num;
+                }
+                ++components_num;
+            }
+        }
+    }
+
+    component_epsilon_.assign(components_num, std::vector<int>());
+    transitions_.assign(UCHAR_MAX + 1, std::vector<Transition>());
+    for (int i = 0; i < states_num; ++i) {
+        for (int target : states_[i].epsilon) {
+            if (component_[target] != component_[i]) {
+                component_epsilon_[component_[i]].push_back(component_[target]);
+            }
+        }
+        if (states_[i].next != -1) {
+            transitions_[static_cast<unsigned char>(states_[i].symbol)].push_back({component_[i], component_[states_[i].next]});
+        }
+    }
+
+}
+
+int FactorAutomaton::GetMaxSubwordLength(const std::string& word) const {
+
+    // O(n * m)
+    // For every state the simulation keeps the earliest position a run ending in this state
+    // could start from (every state is initial, so a run may start anywhere).
+    // A subword (i, j) is accepted iff some state has a run started at i after reading j symbols.
+
+    if (!IsValid()) {
+        return CompiledRegex::ERROR;
+    }
+    for (char symbol : word) {
+        if (!alphabet_.Contains(symbol)) {
+            return CompiledRegex::ERROR;
+        }
+    }
+
+    const int kNone = INT_MAX;
+    int components_num = component_epsilon_.size();
+    int length = word.length();
+    std::vector<int> start(components_num, kNone);
+    std::vector<int> next_start(components_num);
+    int max_subword_length = 0;
+
+    for (int j = 0; j < length; ++j) {
+
+        std::fill(next_start.begin(), next_start.end(), kNone);
+        for (const Transition& transition : transitions_[static_cast<unsigned char>(word[j])]) {
+            // a run can also start right here, at position j
+            int from = std::min(start[transition.from], j);
+            next_start[transition.to] = std::min(next_start[transition.to], from);
+        }
+
+        // epsilon closure: components go in topological order from bigger numbers to smaller
+        int earliest = kNone;
+        for (int component = components_num - 1; component >= 0; --component) {
+            int current = next_start[component];
+            if (current == kNone) {
+                continue;
+            }
+            earliest = std::min(earliest, current);
+            for (int target : component_epsilon_[component]) {
+                next_start[target] = std::min(next_start[target], current);
+            }
+        }
+
+        if (earliest != kNone) {
+            max_subword_length = std::max(max_subword_length, j + 1 - earliest);
+        }
+        start.swap(next_start);
+
+    }
+
+    return max_subword_length;
+
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "alphabet.h"
+#include "compiled_regex.h"
+
+class IncrementalRegex {
+    /*
+    Evaluation of a compiled regexpr for a word that is given one symbol at a time.
+    Every node keeps its four relations (subword, full, prefix, suffix) column by column:
+    column j holds all i such that (i, j) is in the relation. Appending a symbol only adds
+    column n + 1 to every node, it is computed from the new columns of the children
+    and the old columns of the node, O(n^2 / 64) per node instead of a full O(n^3 / 64) rebuild.
+    */
+public:
+    explicit IncrementalRegex(CompiledRegex regex);
+    void Append(char symbol);
+    int GetMaxSubwordLength() const;
+private:
+    typedef uint64_t Word;
+    static const int kWordBits = 64;
+    class Relation {
+        /*
+        Upper-triangular relation stored by columns: column j has (j / 64 + 1) words.
+        */
+    public:
+        Word* AddColumn();
+        Word* Column(int index) { return columns_.data() + offsets_[index]; }
+        const Word* Column(int index) const { return columns_.data() + offsets_[index]; }
+    private:
+        std::vector<Word> columns_;
+        std::vector<size_t> offsets_;
+    };
+    struct NodeRelations {
+        Relation subword_indexes;
+        Relation full_indexes;
+        Relation prefix_indexes;
+        Relation suffix_indexes;
+    };
+    // column |= OR of source columns k for every k <= last set in selector
+    static void AddProduct(Word* column, const Relation& source, const Word* selector, int last);
+    static void OrColumn(Word* column, const Word* source, int column_index);
+    void AddNodeColumns(int node_index, char symbol);
+    CompiledRegex regex_;
+    std::vector<NodeRelations> relations_;  // by node index
+    int length_ = 0;
+    int max_subword_length_ = 0;
+    bool error_ = false;
+};
+
+IncrementalRegex::Word* IncrementalRegex::Relation::AddColumn() {
+    int index = offsets_.size();
+    offsets_.push_back(columns_.size());
+    columns_.resize(columns_.size() + index / kWordBits + 1, 0);
+    return Column(index);
+}
+
+IncrementalRegex::IncrementalRegex(CompiledRegex regex)
+    : regex_(std::move(regex)), relations_(regex_.nodes_.size()) {
+
+    if (!regex_.IsValid()) {
+        error_ = true;
+        return;
+    }
+
+    // column 0: only the empty subword (0, 0)
+    for (size_t i = 0; i < relations_.size(); ++i) {
+        AddNodeColumns(i, 0);
+    }
+
+}
+
+void IncrementalRegex::Append(char symbol) {
+
+    // O(m * n^2 / 64)
+
+    if (error_ || !regex_.alphabet_.Contains(symbol)) {
+        error_ = true;
+        return;
+    }
+
+    ++length_;
+    // children are before parents, so their new columns are ready when a parent needs them
+    for (size_t i = 0; i < relations_.size(); ++i) {
+        AddNodeColumns(i, symbol);
+    }
+
+    // the longest new subword of the root ends at length_ and starts at the lowest set bit
+    const Word* column = relations_.back().subword_indexes.Column(length_);
+    for (int word = 0; word <= length_ / kWordBits; ++word) {
+        if (column[word] != 0) {
+            int first = word * kWordBits + __builtin_ctzll(column[word]);
+            max_subword_length_ = std::max(max_subword_length_, length_ - first);
+            break;
+        }
+    }
+
+}
+
+int IncrementalRegex::GetMaxSubwordLength() const {
+    return error_ ? CompiledRegex::ERROR : max_subword_length_;
+}
+
+void IncrementalRegex::AddProduct(Word* column, const Relation& source, const Word* selector, int last) {
+    for (int word = 0; word <= last / kWordBits; ++word) {
+        Word bits = selector[word];
+        if (word == last / kWordBits) {
+            bits &= ~(~Word(1) << (last % kWordBits));  // only k <= last
+        }
+        while (bits != 0) {
+            int k = word * kWordBits + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            OrColumn(column, source.Column(k), k);
+        }
+    }
+}
+
+void IncrementalRegex::OrColumn(Word* column, const Word* source, int column_index) {
+    for (int word = 0; word <= column_index / kWordBits; ++word) {
+        column[word] |= source[word];
+    }
+}
+
+void IncrementalRegex::AddNodeColumns(int node_index, char symbol) {
+
+    // new column j = length_ of every relation of the node, same formulas as in Result,
+    // written for one column: (lhs x rhs)[:, j] is OR of lhs columns k for every (k, j) in rhs
+
+    const CompiledRegex::Node& node = regex_.nodes_[node_index];
+    NodeRelations& current = relations_[node_index];
+    int j = length_;
+    Word* subword = current.subword_indexes.AddColumn();
+    Word* full = current.full_indexes.AddColumn();
+    Word* prefix = current.prefix_indexes.AddColumn();
+    Word* suffix = current.suffix_indexes.AddColumn();
+    Word bit_j = Word(1) << (j % kWordBits);
+
+    if (node.symbol == '1') {
+
+        subword[j / kWordBits] |= bit_j;
+        full[j / kWordBits] |= bit_j;
+        prefix[j / kWordBits] |= bit_j;
+        suffix[j / kWordBits] |= bit_j;
+
+    } else if (node.symbol == '*') {
+
+        const NodeRelations& last = relations_[node.lhs];
+        // full: chains of full words, (i, j) is in it if (i, k) is and last has full (k, j), k < j
+        // ((i, j) with (j, j) gives nothing new, so column j itself is not needed)
+        full[j / kWordBits] |= bit_j;
+        if (j > 0) {
+            AddProduct(full, current.full_indexes, last.full_indexes.Column(j), j - 1);
+        }
+
+        OrColumn(prefix, full, j);
+        AddProduct(prefix, current.full_indexes, last.prefix_indexes.Column(j), j);
+        OrColumn(suffix, full, j);
+        AddProduct(suffix, last.suffix_indexes, full, j);
+
+        OrColumn(subword, last.subword_indexes.Column(j), j);
+        OrColumn(subword, prefix, j);
+        OrColumn(subword, suffix, j);
+        AddProduct(subword, last.suffix_indexes, prefix, j);
+
+    } else if (node.symbol == '+' || node.symbol == '.') {
+
+        const NodeRelations& lhs = relations_[node.lhs];
+        const NodeRelations& rhs = relations_[node.rhs];
+        if (node.symbol == '+') {
+            OrColumn(subword, lhs.subword_indexes.Column(j), j);
+            OrColumn(subword, rhs.subword_indexes.Column(j), j);
+            OrColumn(full, lhs.full_indexes.Column(j), j);
+            OrColumn(full, rhs.full_indexes.Column(j), j);
+            OrColumn(prefix, lhs.prefix_indexes.Column(j), j);
+            OrColumn(prefix, rhs.prefix_indexes.Column(j), j);
+            OrColumn(suffix, lhs.suffix_indexes.Column(j), j);
+            OrColumn(suffix, rhs.suffix_indexes.Column(j), j);
+        } else {
+            OrColumn(subword, lhs.subword_indexes.Column(j), j);
+            OrColumn(subword, rhs.subword_indexes.Column(j), j);
+            OrColumn(prefix, lhs.prefix_indexes.Column(j), j);
+            OrColumn(suffix, rhs.suffix_indexes.Column(j), j);
+            AddProduct(subword, lhs.suffix_indexes, rhs.prefix_indexes.Column(j), j);
+            AddProduct(prefix, lhs.full_indexes, rhs.prefix_indexes.Column(j), j);
+            AddProduct(suffix, lhs.suffix_indexes, rhs.full_indexes.Column(j), j);
+            AddProduct(full, lhs.full_indexes, rhs.full_indexes.Column(j), j);
+        }
+
+    } else if (j > 0 && node.symbol == symbol) {
+
+        // (j - 1, j) is the new symbol
+        Word bit = Word(1) << ((j - 1) % kWordBits);
+        subword[(j - 1) / kWordBits] |= bit;
+        full[(j - 1) / kWordBits] |= bit;
+        prefix[(j - 1) / kWordBits] |= bit;
+        suffix[(j - 1) / kWordBits] |= bit;
+
+    }
+
+}
@@ -1,33 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 class Matrix {
+    /*
+    Boolean (n + 1) x (n + 1) matrix of subword indexes.
+    Only cells (i, j) with i <= j are used, so the matrix is stored upper-triangular:
+    row i keeps 64-bit words from the one containing column i up to the last one.
+    With band >= 0 row i also ends at column i + band (only subwords of length <= band are kept).
+    Rows are contiguous, so they can be combined word by word.
+    A default-constructed matrix is empty: it has no cells and takes no memory,
+    Set, +=, AddProduct and Close on it do nothing, adding it to another matrix adds nothing.
+    Other matrices combined by += must have the same size and band.
+    */
 public:
-    explicit Matrix(int size): size_(size + 1), capacity_((size + 1) * (size + 1)),
-        matrix_((size + 1) * (size + 1), false) {}
-    auto operator()(int first, int second);
+    Matrix() : size_(0), band_(-1), row_words_(0) {}
+    explicit Matrix(int size, int band = -1);
+    void Reset(int size, int band = -1);
+    bool operator()(int first, int second) const;
+    void Set(int first, int second);
     Matrix& operator+=(const Matrix& other);
     Matrix operator+(const Matrix& other) const;
+    bool operator==(const Matrix& other) const;
+    bool operator!=(const Matrix& other) const;
+    Matrix& AddProduct(const Matrix& lhs, const Matrix& rhs);
+    Matrix& Close();
+    int MaxDistance() const;  // cells beyond the band are not counted
+    bool IsEmpty() const { return size_ == 0; }
 private:
-    std::vector<bool> matrix_;
+    typedef uint64_t Word;
+    static const int kWordBits = 64;
+    static const int kRowTile = 64;  // rows of lhs handled together
+    static const int kInnerTile = 256;  // rows of rhs kept hot in cache
+    static const int kColumnTile = 512;  // words of a row handled together
+    static void OrRow(Word* destination, const Word* source, int count);
+    // row words are indexed by column / 64, valid from RowBegin(index) to RowEnd(index)
+    Word* Row(int index) { return matrix_.data() + row_offsets_[index]; }
+    const Word* Row(int index) const { return matrix_.data() + row_offsets_[index]; }
+    static int RowBegin(int index) { return index / kWordBits; }
+    int RowEnd(int index) const;
     int size_;
-    int capacity_;
+    int band_;
+    int row_words_;
+    std::vector<size_t> row_offsets_;  // offset of word 0 of each row (words before RowBegin are not stored)
+    std::vector<Word> matrix_;
 };
 
-auto Matrix::operator()(int first, int second) {
-    return matrix_[first * size_ + second];
+Matrix::Matrix(int size, int band) {
+    Reset(size, band);
+}
+
+void Matrix::Reset(int size, int band) {
+
+    // O(n^2 / 128)
+    // clears the matrix and gives it a new shape, memory is reused if it is big enough
+
+    size_ = size + 1;
+    band_ = band;
+    row_words_ = (size_ + kWordBits - 1) / kWordBits;
+    row_offsets_.resize(size_);
+
+    size_t capacity = 0;
+    for (int i = 0; i < size_; ++i) {
+        row_offsets_[i] = capacity - RowBegin(i);
+        capacity += RowEnd(i) - RowBegin(i);
+    }
+    matrix_.assign(capacity, 0);
+
+}
+
+int Matrix::RowEnd(int index) const {
+    if (band_ < 0 || index + band_ >= size_) {
+        return row_words_;
+    }
+    return (index + band_) / kWordBits + 1;
+}
+
+bool Matrix::operator()(int first, int second) const {
+    if (second < first || second / kWordBits >= RowEnd(first)) {
+        return false;
+    }
+    return (Row(first)[second / kWordBits] >> (second % kWordBits)) & 1u;
+}
+
+void Matrix::Set(int first, int second) {
+    if (second / kWordBits < RowEnd(first)) {
+        Row(first)[second / kWordBits] |= Word(1) << (second % kWordBits);
+    }
 }
 
 Matrix& Matrix::operator+=(const Matrix& other) {
-    // O(n^2)
-    for (int i = 0; i < capacity_; ++i) {
-        matrix_[i] = matrix_[i] || other.matrix_[i];
+    // O(n^2 / 128), only stored cells are touched
+    // an empty matrix has no cells: nothing is added from it or into it
+    if (IsEmpty() || other.IsEmpty()) {
+        return *this;
     }
+    assert(size_ == other.size_ && band_ == other.band_);
+    OrRow(matrix_.data(), other.matrix_.data(), matrix_.size());
     return *this;
 }
 
 Matrix Matrix::operator+(const Matrix& other) const {
-    // O(n^2)
+    // O(n^2 / 128)
     Matrix result = other;
     result += *this;
     return result;
 }
+
+bool Matrix::operator==(const Matrix& other) const {
+    return size_ == other.size_ && band_ == other.band_ && matrix_ == other.matrix_;
+}
+
+bool Matrix::operator!=(const Matrix& other) const {
+    return !(*this == other);
+}
+
+void Matrix::OrRow(Word* destination, const Word* source, int count) {
+    int i = 0;
+#ifdef __AVX2__
+    for (; i + 4 <= count; i += 4) {
+        __m256i lhs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(destination + i));
+        __m256i rhs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), _mm256_or_si256(lhs, rhs));
+    }
+#endif
+    for (; i < count; ++i) {
+        destination[i] |= source[i];
+    }
+}
+
+Matrix& Matrix::AddProduct(const Matrix& lhs, const Matrix& rhs) {
+
+    // O(n^3 / 64)
+    // *this |= lhs x rhs: (i, k) is added if lhs(i, j) and rhs(j, k) for some j.
+    // Row i of the result is OR of rhs rows j for every bit j set in lhs row i.
+    // Both operands are upper-triangular, so j >= i and row j starts at word j / 64.
+
+    for (int row_begin = 0; row_begin < size_; row_begin += kRowTile) {
+        int row_end = std::min(size_, row_begin + kRowTile);
+        // with a band the tile reaches only the stored words of its last row, not the whole width
+        int column_limit = RowEnd(row_end - 1);
+        int inner_limit = std::min(size_, column_limit * kWordBits);
+        for (int inner_begin = row_begin; inner_begin < inner_limit; inner_begin += kInnerTile) {
+            int inner_end = std::min(inner_limit, inner_begin + kInnerTile);
+            for (int column_begin = RowBegin(inner_begin); column_begin < column_limit;
+                 column_begin += kColumnTile) {
+                int column_end = std::min(column_limit, column_begin + kColumnTile);
+
+                for (int i = row_begin; i < row_end; ++i) {
+                    const Word* lhs_row = lhs.Row(i);
+                    Word* result_row = Row(i);
+                    // columns beyond the band of row i are not stored
+                    int result_end = std::min(column_end, RowEnd(i));
+                    int first = std::max(i, inner_begin);
+                    int last = std::min(inner_end, lhs.RowEnd(i) * kWordBits);
+                    for (int word = first / kWordBits; word * kWordBits < last; ++word) {
+                        Word bits = lhs_row[word];
+                        // dropping bits outside [first, last)
+                        if (word * kWordBits < first) {
+                            bits &= ~Word(0) << (first % kWordBits);
+                        }
+                        if ((word + 1) * kWordBits > last) {
+                            bits &= ~(~Word(0) << (last % kWordBits));
+                        }
+                        while (bits != 0) {
+                            int j = word * kWordBits + __builtin_ctzll(bits);
+                            bits &= bits - 1;
+                            int from = std::max(column_begin, RowBegin(j));
+                            int to = std::min(result_end, rhs.RowEnd(j));
+                            if (from < to) {
+                                OrRow(result_row + from, rhs.Row(j) + from, to - from);
+                            }
+                        }
+                    }
+                }
+
+            }
+        }
+    }
+
+    return *this;
+
+}
+
+Matrix& Matrix::Close() {
+
+    // O(n^3 / 64)
+    // Replaces the relation with its reflexive-transitive closure.
+    // Since every pair (i, j) has i <= j, rows are closed from the last one to the first:
+    // when row i is handled, every row j > i it refers to is already closed,
+    // so row i is just OR of those rows, and one pass is enough.
+    // Bits of row i are visited from the highest one: OR with row j adds only columns >= j,
+    // which are already visited, so no copy of the original row is needed.
+
+    for (int i = size_ - 1; i >= 0; --i) {
+        Word* row = Row(i);
+        int first_word = RowBegin(i);
+        int last_word = RowEnd(i);
+        for (int word = last_word - 1; word >= first_word; --word) {
+            Word bits = row[word];
+            if (word == first_word) {
+                bits &= ~Word(0) << (i % kWordBits) << 1;  // only j > i
+            }
+            while (bits != 0) {
+                int bit = kWordBits - 1 - __builtin_clzll(bits);
+                int j = word * kWordBits + bit;
+                bits &= ~(Word(1) << bit);
+                if (j < size_) {
+                    int to = std::min(last_word, RowEnd(j));
+                    OrRow(row + RowBegin(j), Row(j) + RowBegin(j), to - RowBegin(j));
+                }
+            }
+        }
+        Set(i, i);
+    }
+
+    return *this;
+
+}
+
+int Matrix::MaxDistance() const {
+
+    // O(n^2 / 128)
+    // maximal j - i among set cells, 0 if there are none
+
+    int max_distance = 0;
+    for (int i = 0; i < size_; ++i) {
+        const Word* row = Row(i);
+        // the last stored word of a banded row may have columns beyond i + band
+        Word last_mask = ~Word(0);
+        if (band_ >= 0 && i + band_ < size_) {
+            last_mask >>= kWordBits - 1 - (i + band_) % kWordBits;
+        }
+        for (int word = RowEnd(i) - 1; word >= RowBegin(i); --word) {
+            Word bits = row[word] & (word == RowEnd(i) - 1 ? last_mask : ~Word(0));
+            if (bits != 0) {
+                int j = word * kWordBits + (kWordBits - 1 - __builtin_clzll(bits));
+                max_distance = std::max(max_distance, j - i);
+                break;
+            }
+        }
+    }
+    return max_distance;
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include "matrix.h"
+
+class MatrixPool {
+    /*
+    Matrices that are not used any more, kept to be reused instead of allocating new ones.
+    Once the pool has enough matrices of the needed size, Acquire doesn't allocate memory.
+    */
+public:
+    Matrix Acquire(int size, int band = -1);
+    void Release(Matrix&& matrix);
+    int Size() const;
+private:
+    std::vector<Matrix> matrices_;
+};
+
+Matrix MatrixPool::Acquire(int size, int band) {
+    if (matrices_.empty()) {
+        return Matrix(size, band);
+    }
+    Matrix matrix = std::move(matrices_.back());
+    matrices_.pop_back();
+    matrix.Reset(size, band);
+    return matrix;
+}
+
+void MatrixPool::Release(Matrix&& matrix) {
+    matrices_.push_back(std::move(matrix));
+}
+
+int MatrixPool::Size() const {
+    return matrices_.size();
+}
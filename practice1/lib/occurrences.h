@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "alphabet.h"
+
+class Occurrences {
+    /*
+    Positions of every symbol of a word: one bitset per symbol that occurs in it,
+    all of them are built in one pass over the word. A regexpr letter reads only the bitset
+    of its symbol, O(n / 64) instead of a pass over the word for every letter.
+    Memory is reused by the next word: a word that isn't longer and has no more different symbols
+    doesn't allocate.
+    */
+public:
+    typedef uint64_t Word;
+    static const int kWordBits = 64;
+    Occurrences() { bitsets_.fill(-1); }  // occurrences in the empty word
+    bool Reset(const std::string& word, const Alphabet& alphabet);  // false if word has a symbol not in alphabet
+    int Length() const { return length_; }
+    int WordsNum() const { return words_num_; }  // words of every bitset
+    // bit i is set if word[i] == symbol, nullptr if symbol doesn't occur in word
+    const Word* Positions(char symbol) const;
+private:
+    std::array<int, 256> bitsets_;  // index of the bitset of symbol, -1 if it doesn't occur
+    std::vector<Word> bits_;  // bitsets one after another
+    int length_ = 0;
+    int words_num_ = 0;
+};
+
+bool Occurrences::Reset(const std::string& word, const Alphabet& alphabet) {
+
+    // O(n)
+
+    length_ = word.length();
+    words_num_ = (length_ + kWordBits - 1) / kWordBits;
+    bitsets_.fill(-1);
+    bits_.clear();
+
+    for (int i = 0; i < length_; ++i) {
+        if (!alphabet.Contains(word[i])) {
+            return false;
+        }
+        int& bitset = bitsets_[static_cast<unsigned char>(word[i])];
+        if (bitset == -1) {
+            bitset = bits_.size() / words_num_;
+            bits_.resize(bits_.size() + words_num_, 0);
+        }
+        bits_[bitset * words_num_ + i / kWordBits] |= Word(1) << (i % kWordBits);
+    }
+    return true;
+
+}
+
+const Occurrences::Word* Occurrences::Positions(char symbol) const {
+    int bitset = bitsets_[static_cast<unsigned char>(symbol)];
+    return bitset == -1 ? nullptr : bits_.data() + bitset * words_num_;
+}
@@ -1,34 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
 #include <utility>
-#include <stack>
-#include "result.h"
+#include "alphabet.h"
+#include "compiled_regex.h"
+#include "factor_automaton.h"
+#include "incremental_regex.h"
+#include "thread_pool.h"
 
 class RegexprParser {
     /*
     Interface for parsing regexpr and counting maximal subword length.
     */
 public:
+    enum class Engine {
+        kMatrix,  // subword index matrices, O(m * n^3 / 64)
+        kAutomaton,  // search with factor automaton of the regexpr, O(n * m)
+        kBands  // matrices of doubling band, stops once the answer is proven, O(m * n * A^2 / 64) for answer A
+    };
     explicit RegexprParser(std::string regexpr, std::string word)
         : regexpr_(std::move(regexpr)), word_(std::move(word)) {}
     int GetMaxSubwordLength();
+    int GetMaxSubwordLength(int max_length);  // only subwords not longer than max_length
+    bool HasSubwordOfLength(int min_length);  // false for incorrect regexpr or word too
     std::string GetWord() const;
     std::string GetRegexpr() const;
     void SetWord(std::string word);
     void SetRegexpr(std::string regexpr);
     std::string GetParsedRegexpr();
-    static const int ERROR = -1;
-    static const int INF = -2;
+    void SetThreadsNum(int threads_num);
+    void SetEngine(Engine engine);
+    void SetAlphabet(const Alphabet& alphabet);  // {a, b, c} by default
+    void AppendChar(char symbol);
+    int CurrentMaxSubwordLength();
+    static const int ERROR = CompiledRegex::ERROR;
+    static const int INF = CompiledRegex::INF;
 private:
-    bool CheckAlphabet() const;
-    bool ParseCurrentSymbol(std::stack<Result>& stack, char current_symbol);
-    void ParseEpsilon(Result& current_result) const;
-    void ParseAlphabet(Result& current_result) const;
-    void ParseStar(std::stack<Result>& stack, Result& current_result) const;
-    void ParsePlus(std::stack<Result>& stack, Result& current_result) const;
-    void ParseConcat(std::stack<Result>& stack, Result& current_result) const;
-    inline static std::unordered_set<char> const alphabet_ = {'a', 'b', 'c'};
+    const CompiledRegex& GetCompiledRegex();
+    CompiledRegex::Evaluator& GetEvaluator();
+    void ResetCompiledRegex();
     std::string regexpr_;
     std::string parsed_regexpr_;
     std::string word_;
+    Alphabet alphabet_;
+    std::unique_ptr<ThreadPool> thread_pool_;  // set in parallel mode
+    std::unique_ptr<CompiledRegex> compiled_;  // current regexpr, compiled on demand
+    // evaluator of compiled_, its matrices are reused by the next words
+    std::unique_ptr<CompiledRegex::Evaluator> evaluator_;
+    std::unique_ptr<IncrementalRegex> incremental_;  // state of AppendChar for current regexpr and word
+    Engine engine_ = Engine::kMatrix;
 };
 
 std::string RegexprParser::GetWord() const {
@@ -41,285 +62,128 @@ std::string RegexprParser::GetRegexpr() const {
 
 void RegexprParser::SetWord(std::string word) {
     word_ = std::move(word);
+    incremental_.reset();
 }
 
 void RegexprParser::SetRegexpr(std::string regexpr) {
     regexpr_ = std::move(regexpr);
+    ResetCompiledRegex();
 }
 
-std::string RegexprParser::GetParsedRegexpr() {
-    if (parsed_regexpr_.empty() && !regexpr_.empty()) {
-        GetMaxSubwordLength();
-    }
-    return parsed_regexpr_;
+void RegexprParser::ResetCompiledRegex() {
+    parsed_regexpr_.clear();
+    evaluator_.reset();
+    compiled_.reset();
+    incremental_.reset();
 }
 
-bool RegexprParser::CheckAlphabet() const {
+void RegexprParser::AppendChar(char symbol) {
 
-    // O(n)
+    // O(m * n^2 / 64), only subwords ending with the new symbol are computed
 
-    for (const auto& symbol : word_) {
-        if (alphabet_.find(symbol) == alphabet_.end()) {
-            return false;
-        }
+    if (!incremental_) {
+        CurrentMaxSubwordLength();
     }
-
-    return true;
+    word_.push_back(symbol);
+    incremental_->Append(symbol);
 
 }
 
-void RegexprParser::ParseEpsilon(Result& current_result) const {
-
-    // O(n)
+int RegexprParser::CurrentMaxSubwordLength() {
 
-    int length = word_.length();
+    // O(1), the first call for a new regexpr or word - O(m * n^3 / 64)
 
-    for (int i = 0; i <= length; ++i) {
-        // inserting indexes everywhere
-        current_result.subword_indexes(i, i) = true;
-        current_result.full_indexes(i, i) = true;
-        current_result.prefix_indexes(i, i) = true;
-        current_result.suffix_indexes(i, i) = true;
+    if (!incremental_) {
+        incremental_ = std::make_unique<IncrementalRegex>(GetCompiledRegex());
+        for (char symbol : word_) {
+            incremental_->Append(symbol);
+        }
     }
+    return incremental_->GetMaxSubwordLength();
 
 }
 
-void RegexprParser::ParseAlphabet(Result& current_result) const {
-
-    // O(n)
-
-    int length = word_.length();
-
-    for (int i = 0; i < length; ++i) {
-        if (word_[i] == current_result.expr.front()) {
-            // inserting indexes everywhere
-            current_result.subword_indexes(i, i + 1) = true;
-            current_result.full_indexes(i, i + 1) = true;
-            current_result.prefix_indexes(i, i + 1) = true;
-            current_result.suffix_indexes(i, i + 1) = true;
-        }
+std::string RegexprParser::GetParsedRegexpr() {
+    if (parsed_regexpr_.empty() && !regexpr_.empty()) {
+        parsed_regexpr_ = GetCompiledRegex().GetParsedRegexpr();
     }
-
+    return parsed_regexpr_;
 }
 
-void RegexprParser::ParseStar(std::stack<Result>& stack, Result& current_result) const {
-
-    // O(n^3 * log(n) + m)
-
-    Result last_result = std::move(stack.top());
-    stack.pop();
-
-    current_result.expr = std::move(last_result.expr) + '*';
-
-    int length = word_.length();
-
-    // inserting empty words everywhere
-    for (int i = 0; i <= length; ++i) {
-        current_result.subword_indexes(i, i) = true;
-        current_result.full_indexes(i, i) = true;
-        current_result.prefix_indexes(i, i) = true;
-        current_result.suffix_indexes(i, i) = true;
+const CompiledRegex& RegexprParser::GetCompiledRegex() {
+    // O(m) once for a regexpr
+    if (!compiled_) {
+        compiled_ = std::make_unique<CompiledRegex>(regexpr_, alphabet_);
     }
-
-    current_result.subword_indexes += last_result.subword_indexes;
-    current_result.full_indexes += last_result.full_indexes;
-    current_result.prefix_indexes += last_result.prefix_indexes;
-    current_result.suffix_indexes += last_result.suffix_indexes;
-
-    int new_subwords = 0;
-    do {
-        new_subwords = 0;
-        for (int i = 0; i <= length; ++i) {
-            for (int j = i; j <= length; ++j) {
-                for (int k = j; k <= length; ++k) {
-
-                    if (last_result.suffix_indexes(i, j) && current_result.prefix_indexes(j, k)
-                    && !current_result.subword_indexes(i, k)) {
-
-                        current_result.subword_indexes(i, k) = true;
-
-                        if (last_result.full_indexes(i, j)) {
-                            current_result.prefix_indexes(i, k) = true;
-                            if (current_result.full_indexes(j, k)) {
-                                current_result.full_indexes(i, k) = true;
-                            }
-                        }
-
-                        if (current_result.full_indexes(j, k)) {
-                            current_result.suffix_indexes(i, k) = true;
-                        }
-
-                        ++new_subwords;
-
-                    }
-
-                }
-            }
-        }
-    } while (new_subwords > 0);
-
+    return *compiled_;
 }
 
-void RegexprParser::ParsePlus(std::stack<Result>& stack, Result& current_result) const {
-
-    // O(n^2 + m)
-
-    Result rhs = std::move(stack.top());
-    stack.pop();
-    Result lhs = std::move(stack.top());
-    stack.pop();
-
-    current_result.expr = '(' + std::move(lhs.expr) + '+' + std::move(rhs.expr) + ')';
-
-    // just copying everything from lhs and rhs
-
-    current_result.subword_indexes += lhs.subword_indexes;
-    current_result.subword_indexes += rhs.subword_indexes;
-    current_result.full_indexes += lhs.full_indexes;
-    current_result.full_indexes += rhs.full_indexes;
-    current_result.prefix_indexes += lhs.prefix_indexes;
-    current_result.prefix_indexes += rhs.prefix_indexes;
-    current_result.suffix_indexes += lhs.suffix_indexes;
-    current_result.suffix_indexes += rhs.suffix_indexes;
-
+void RegexprParser::SetThreadsNum(int threads_num) {
+    // 1 - sequential evaluation (default), otherwise independent subtrees
+    // are evaluated in parallel by threads_num threads (0 - by all hardware threads)
+    if (threads_num == 1) {
+        thread_pool_.reset();
+    } else {
+        thread_pool_ = std::make_unique<ThreadPool>(threads_num);
+    }
 }
 
-void RegexprParser::ParseConcat(std::stack<Result>& stack, Result& current_result) const {
-
-    // O(n^3 + m)
-
-    Result rhs = std::move(stack.top());
-    stack.pop();
-    Result lhs = std::move(stack.top());
-    stack.pop();
-
-    current_result.expr = '(' + std::move(lhs.expr) + std::move(rhs.expr) + ')';
-
-    current_result.subword_indexes += lhs.subword_indexes;
-    current_result.subword_indexes += rhs.subword_indexes;
-    current_result.prefix_indexes += lhs.prefix_indexes;
-    current_result.suffix_indexes += rhs.suffix_indexes;
-
-    int length = word_.length();
-
-    // concat lhs suffixes with rhs prefixes
-    for (int i = 0; i <= length; ++i) {
-        for (int j = i; j <= length; ++j) {
-            for (int k = j; k <= length; ++k) {
-
-                if (lhs.suffix_indexes(i, j) && rhs.prefix_indexes(j, k)) {
+void RegexprParser::SetEngine(Engine engine) {
+    engine_ = engine;
+}
 
-                    current_result.subword_indexes(i, k) = true;
+void RegexprParser::SetAlphabet(const Alphabet& alphabet) {
+    alphabet_ = alphabet;
+    ResetCompiledRegex();  // the regexpr is compiled again for the alphabet
+}
 
-                    if (lhs.full_indexes(i, j)) {
-                        current_result.prefix_indexes(i, k) = true;
-                        if (rhs.full_indexes(j, k)) {
-                            current_result.full_indexes(i, k) = true;
-                        }
-                    }
+int RegexprParser::GetMaxSubwordLength() {
 
-                    if (rhs.full_indexes(j, k)) {
-                        current_result.suffix_indexes(i, k) = true;
-                    }
+    // O(m * n^3 / 64) for the matrix engine, every different subexpression is evaluated once
 
-                }
+    if (engine_ == Engine::kAutomaton) {
+        return FactorAutomaton(regexpr_, alphabet_).GetMaxSubwordLength(word_);
+    }
 
-            }
-        }
+    if (engine_ == Engine::kBands) {
+        // bands are evaluated one after another, sequentially
+        return GetEvaluator().EvaluateByBands(word_);
     }
+    if (thread_pool_) {
+        // parallel mode: sibling subtrees are evaluated as separate tasks
+        return GetCompiledRegex().Evaluate(word_, *thread_pool_);
+    }
+    return GetEvaluator().Evaluate(word_);
 
 }
 
-bool RegexprParser::ParseCurrentSymbol(std::stack<Result>& stack, char current_symbol) {
-
-    // O(n^3 * log(n) + m)
-
-    Result current_result(current_symbol, word_.length());
-
-    if (current_symbol == '1') {
-
-        ParseEpsilon(current_result);
-
-    } else if (alphabet_.find(current_symbol) != alphabet_.end()) {
-
-        ParseAlphabet(current_result);
-
-    } else if (current_symbol == '*') {
-
-        if (stack.empty()) {
-            // requires 1 argument
-            return false;
-        }
-        ParseStar(stack, current_result);
+int RegexprParser::GetMaxSubwordLength(int max_length) {
 
-    } else if (current_symbol == '+') {
+    // O(m * n * w^2 / 64) with the matrix engines, w = max_length; O(n * m) with the automaton engine
 
-        if (stack.size() < 2) {
-            // requires 2 arguments
-            return false;
-        }
-        ParsePlus(stack, current_result);
-
-    } else if (current_symbol == '.') {
-
-        if (stack.size() < 2) {
-            // requires 2 arguments
-            return false;
-        }
-        ParseConcat(stack, current_result);
-
-    } else {
-        // regexpr is incorrect
-        return false;
+    if (engine_ == Engine::kAutomaton) {
+        // subwords of a fitting subword fit too, so the answer is just cut to max_length
+        int max_subword_length = FactorAutomaton(regexpr_, alphabet_).GetMaxSubwordLength(word_);
+        return max_subword_length == ERROR ? ERROR : std::min(max_subword_length, std::max(max_length, 0));
     }
-
-    // parsing is correct, pushing result to stack
-    stack.emplace(current_result);
-    return true;
+    return GetEvaluator().Evaluate(word_, max_length);
 
 }
 
-int RegexprParser::GetMaxSubwordLength() {
-
-    // O(m * n^3 * log(n) + m^2)
-
-    if (!CheckAlphabet()) {
-        return ERROR;
-    }
+bool RegexprParser::HasSubwordOfLength(int min_length) {
 
-    std::stack<Result> stack;
-    int regexpr_length = regexpr_.length();
+    // O(m * n * w^2 / 64), w = min_length; O(n * m) with the automaton engine
 
-    // parsing each regexpr symbol
-    for (int i = 0; i < regexpr_length; ++i) {
-        if (!ParseCurrentSymbol(stack, regexpr_[i])) {
-            return ERROR;
-        }
+    if (engine_ == Engine::kAutomaton) {
+        return FactorAutomaton(regexpr_, alphabet_).GetMaxSubwordLength(word_) >= std::max(min_length, 0);
     }
+    return GetEvaluator().HasSubword(word_, min_length);
 
-    if (regexpr_length == 0) {
-        // cannot parse a word with empty regexpr
-        return ERROR;
-    }
-
-    Result result = std::move(stack.top());
-    parsed_regexpr_ = result.expr;
-
-    if (stack.size() > 1 || stack.empty()) {
-        // some regexpr parts haven't been combined => incorrect regexpr
-        return ERROR;
-    }
+}
 
-    int length = word_.length();
-    int max_subword_length = 0;
-    for (int i = 0; i <= length; ++i) {
-        for (int j = i; j <= length; ++j) {
-            if (result.subword_indexes(i, j) && (j - i > max_subword_length)) {
-                max_subword_length = j - i;
-            }
-        }
+CompiledRegex::Evaluator& RegexprParser::GetEvaluator() {
+    if (!evaluator_) {
+        evaluator_ = std::make_unique<CompiledRegex::Evaluator>(GetCompiledRegex());
     }
-
-    return max_subword_length;
-
+    return *evaluator_;
 }
@@ -1,5 +1,9 @@
+#pragma once
+
 #include <string>
 #include "matrix.h"
+#include "matrix_pool.h"
+#include "occurrences.h"
 
 struct Result {
     /*
@@ -7,16 +11,181 @@ struct Result {
     It contains current regexpr part,
     indexes of subwords that fit this part
     and maximal subword length for this part.
+    Only the relations given on construction are computed, the others are empty matrices.
+    With band >= 0 only subwords of length <= band are kept: (i, k) of a product or closure
+    is made only of pairs inside [i, k], which are kept too, so kept cells are exact.
     */
-    explicit Result(std::string expr, int size)
+    enum Relation {
+        kSubword = 1,
+        kFull = 2,
+        kPrefix = 4,
+        kSuffix = 8,
+        kAllRelations = 15
+    };
+    explicit Result(std::string expr, int size, int relations = kAllRelations)
         : expr(std::move(expr)),
-        subword_indexes(size), full_indexes(size), prefix_indexes(size), suffix_indexes(size) {}
+        subword_indexes(relations & kSubword ? Matrix(size) : Matrix()),
+        full_indexes(relations & kFull ? Matrix(size) : Matrix()),
+        prefix_indexes(relations & kPrefix ? Matrix(size) : Matrix()),
+        suffix_indexes(relations & kSuffix ? Matrix(size) : Matrix()) {}
     explicit Result(char symbol, int size):
         subword_indexes(size), full_indexes(size),
         prefix_indexes(size), suffix_indexes(size) { expr.push_back(symbol); }
+    explicit Result(std::string expr, MatrixPool& pool, int size, int relations = kAllRelations, int band = -1)
+        : expr(std::move(expr)),
+        subword_indexes(relations & kSubword ? pool.Acquire(size, band) : Matrix()),
+        full_indexes(relations & kFull ? pool.Acquire(size, band) : Matrix()),
+        prefix_indexes(relations & kPrefix ? pool.Acquire(size, band) : Matrix()),
+        suffix_indexes(relations & kSuffix ? pool.Acquire(size, band) : Matrix()) {}
+    // demand analysis: relations a node with symbol computes to give the demanded ones
+    // (a star needs its own full relation for the others) and relations its operands must give then
+    static constexpr int ComputedRelations(char symbol, int demanded);
+    static constexpr int LhsRelations(char symbol, int computed);
+    static constexpr int RhsRelations(char symbol, int computed);
+    void Release(MatrixPool& pool);
+    void AddEpsilon(int length);
+    void AddSymbol(const Occurrences& occurrences, char symbol);
+    void AddStar(const Result& last_result);
+    void AddPlus(const Result& lhs, const Result& rhs);
+    void AddConcat(const Result& lhs, const Result& rhs);
     std::string expr;
     Matrix subword_indexes;  // subwords detected by regexpr subword
     Matrix full_indexes;  // subwords detected by full regexpr
     Matrix prefix_indexes;  // subwords detected by regexpr prefix
     Matrix suffix_indexes;  // subwords detected by regexpr suffix
 };
+
+constexpr int Result::ComputedRelations(char symbol, int demanded) {
+    if (symbol != '*' || demanded == kFull) {
+        return demanded;
+    }
+    // subword = subword + prefix + suffix + suffix x prefix, prefix and suffix are made of full
+    return (demanded & kSubword ? kAllRelations : demanded | kFull);
+}
+
+constexpr int Result::LhsRelations(char symbol, int computed) {
+    if (symbol == '.') {
+        // subword needs lhs suffixes, prefix needs lhs full words
+        return (computed & (kSubword | kSuffix)) | (computed & kSubword ? kSuffix : 0)
+            | (computed & (kPrefix | kFull) ? kFull : 0) | (computed & kPrefix);
+    }
+    if (symbol == '*') {
+        // full is the closure of lhs full, prefix adds lhs prefixes, suffix adds lhs suffixes
+        return computed | kFull;
+    }
+    return computed;  // '+'
+}
+
+constexpr int Result::RhsRelations(char symbol, int computed) {
+    if (symbol == '.') {
+        // subword needs rhs prefixes, suffix needs rhs full words
+        return (computed & (kSubword | kPrefix)) | (computed & kSubword ? kPrefix : 0)
+            | (computed & (kSuffix | kFull) ? kFull : 0) | (computed & kSuffix);
+    }
+    return computed;  // '+'
+}
+
+void Result::Release(MatrixPool& pool) {
+    // gives the matrices back to the pool, the Result must not be used after that
+    for (Matrix* matrix : {&subword_indexes, &full_indexes, &prefix_indexes, &suffix_indexes}) {
+        if (!matrix->IsEmpty()) {
+            pool.Release(std::move(*matrix));
+        }
+    }
+}
+
+void Result::AddEpsilon(int length) {
+
+    // O(n)
+
+    for (int i = 0; i <= length; ++i) {
+        // inserting indexes everywhere
+        subword_indexes.Set(i, i);
+        full_indexes.Set(i, i);
+        prefix_indexes.Set(i, i);
+        suffix_indexes.Set(i, i);
+    }
+
+}
+
+void Result::AddSymbol(const Occurrences& occurrences, char symbol) {
+
+    // O(n / 64 + occurrences of symbol)
+
+    const Occurrences::Word* positions = occurrences.Positions(symbol);
+    if (positions == nullptr) {
+        return;
+    }
+
+    for (int word = 0; word < occurrences.WordsNum(); ++word) {
+        Occurrences::Word bits = positions[word];
+        while (bits != 0) {
+            int i = word * Occurrences::kWordBits + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            // inserting indexes everywhere
+            subword_indexes.Set(i, i + 1);
+            full_indexes.Set(i, i + 1);
+            prefix_indexes.Set(i, i + 1);
+            suffix_indexes.Set(i, i + 1);
+        }
+    }
+
+}
+
+void Result::AddStar(const Result& last_result) {
+
+    // O(n^3 / 64)
+
+    // words of last_result* fully detected on (i, j) are chains of full last_result words,
+    // i.e. the reflexive-transitive closure of last_result.full_indexes (it has all empty words too)
+    full_indexes += last_result.full_indexes;
+    full_indexes.Close();
+
+    // prefix = chain of full words, then a prefix; suffix = a suffix, then chain of full words
+    prefix_indexes += full_indexes;
+    prefix_indexes.AddProduct(full_indexes, last_result.prefix_indexes);
+    suffix_indexes += full_indexes;
+    suffix_indexes.AddProduct(last_result.suffix_indexes, full_indexes);
+
+    // subword = subword of a single word, or a suffix followed by a prefix of the star
+    subword_indexes += last_result.subword_indexes;
+    subword_indexes += prefix_indexes;
+    subword_indexes += suffix_indexes;
+    subword_indexes.AddProduct(last_result.suffix_indexes, prefix_indexes);
+
+}
+
+void Result::AddPlus(const Result& lhs, const Result& rhs) {
+
+    // O(n^2 / 128)
+
+    // just copying everything from lhs and rhs
+
+    subword_indexes += lhs.subword_indexes;
+    subword_indexes += rhs.subword_indexes;
+    full_indexes += lhs.full_indexes;
+    full_indexes += rhs.full_indexes;
+    prefix_indexes += lhs.prefix_indexes;
+    prefix_indexes += rhs.prefix_indexes;
+    suffix_indexes += lhs.suffix_indexes;
+    suffix_indexes += rhs.suffix_indexes;
+
+}
+
+void Result::AddConcat(const Result& lhs, const Result& rhs) {
+
+    // O(n^3 / 64)
+
+    subword_indexes += lhs.subword_indexes;
+    subword_indexes += rhs.subword_indexes;
+    prefix_indexes += lhs.prefix_indexes;
+    suffix_indexes += rhs.suffix_indexes;
+
+    // concat lhs suffixes with rhs prefixes:
+    // (i, k) is a concatenation if lhs has (i, j) and rhs has (j, k), i.e. a boolean matrix product
+    subword_indexes.AddProduct(lhs.suffix_indexes, rhs.prefix_indexes);
+    prefix_indexes.AddProduct(lhs.full_indexes, rhs.prefix_indexes);
+    suffix_indexes.AddProduct(lhs.suffix_indexes, rhs.full_indexes);
+    full_indexes.AddProduct(lhs.full_indexes, rhs.full_indexes);
+
+}
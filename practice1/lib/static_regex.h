@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include "alphabet.h"
+#include "compiled_regex.h"
+#include "matrix_pool.h"
+#include "occurrences.h"
+#include "result.h"
+
+namespace static_regex {
+
+    // nodes of the operator tree, the tree is a type
+    struct Epsilon {};
+    template <char Symbol>
+    struct Letter {};
+    template <class Operand>
+    struct Star {};
+    template <class Lhs, class Rhs>
+    struct Plus {};
+    template <class Lhs, class Rhs>
+    struct Concat {};
+
+    template <size_t Size>
+    constexpr bool IsValid(const char (&regexpr)[Size]) {
+        // same checks as CompiledRegex, regexpr has Size - 1 symbols and a terminating 0
+        int depth = 0;  // operands on the stack
+        for (size_t i = 0; i + 1 < Size; ++i) {
+            char symbol = regexpr[i];
+            if (symbol == '*') {
+                if (depth < 1) {
+                    return false;
+                }
+            } else if (symbol == '+' || symbol == '.') {
+                if (depth < 2) {
+                    return false;
+                }
+                --depth;
+            } else if (symbol == '1' || Alphabet().Contains(symbol)) {
+                ++depth;
+            } else {
+                return false;
+            }
+        }
+        return depth == 1;
+    }
+
+    // parsing stack, the top is the first node
+    template <class... Nodes>
+    struct Stack {};
+
+    // stack after one regexpr symbol, only valid regexprs are parsed
+    template <class Stack, char Symbol>
+    struct Push;
+    template <class... Nodes, char Symbol>
+    struct Push<Stack<Nodes...>, Symbol> {
+        using Type = Stack<Letter<Symbol>, Nodes...>;
+    };
+    template <class... Nodes>
+    struct Push<Stack<Nodes...>, '1'> {
+        using Type = Stack<Epsilon, Nodes...>;
+    };
+    template <class Operand, class... Nodes>
+    struct Push<Stack<Operand, Nodes...>, '*'> {
+        using Type = Stack<Star<Operand>, Nodes...>;
+    };
+    template <class Rhs, class Lhs, class... Nodes>
+    struct Push<Stack<Rhs, Lhs, Nodes...>, '+'> {
+        using Type = Stack<Plus<Lhs, Rhs>, Nodes...>;
+    };
+    template <class Rhs, class Lhs, class... Nodes>
+    struct Push<Stack<Rhs, Lhs, Nodes...>, '.'> {
+        using Type = Stack<Concat<Lhs, Rhs>, Nodes...>;
+    };
+
+    template <class Stack, char... Symbols>
+    struct Parse;
+    template <class Root>
+    struct Parse<Stack<Root>> {
+        using Type = Root;
+    };
+    template <class... Nodes>
+    struct Parse<Stack<Nodes...>> {
+        using Type = Epsilon;  // incorrect regexpr, only static_assert is reported
+    };
+    template <class Stack, char Symbol, char... Symbols>
+    struct Parse<Stack, Symbol, Symbols...> {
+        using Type = typename Parse<typename Push<Stack, Symbol>::Type, Symbols...>::Type;
+    };
+
+    // Result of the node for the word with given occurrences: operands are evaluated by direct calls,
+    // their matrices go back to the pool as soon as the node is combined.
+    // Relations is the Result::Relation mask the node computes, the demand analysis is done at compile time.
+    template <class Node>
+    struct Evaluator;
+
+    template <>
+    struct Evaluator<Epsilon> {
+        static constexpr char kSymbol = '1';
+        template <int Relations>
+        static void Evaluate(const Occurrences& occurrences, MatrixPool& /*pool*/, Result& result) {
+            result.AddEpsilon(occurrences.Length());
+        }
+    };
+
+    template <char Symbol>
+    struct Evaluator<Letter<Symbol>> {
+        static constexpr char kSymbol = Symbol;
+        template <int Relations>
+        static void Evaluate(const Occurrences& occurrences, MatrixPool& /*pool*/, Result& result) {
+            result.AddSymbol(occurrences, Symbol);
+        }
+    };
+
+    // Demanded - relations the parent needs
+    template <class Node, int Demanded>
+    Result Evaluate(const Occurrences& occurrences, MatrixPool& pool) {
+        constexpr int kRelations = Result::ComputedRelations(Evaluator<Node>::kSymbol, Demanded);
+        Result result(std::string(), pool, occurrences.Length(), kRelations);
+        Evaluator<Node>::template Evaluate<kRelations>(occurrences, pool, result);
+        return result;
+    }
+
+    template <class Operand>
+    struct Evaluator<Star<Operand>> {
+        static constexpr char kSymbol = '*';
+        template <int Relations>
+        static void Evaluate(const Occurrences& occurrences, MatrixPool& pool, Result& result) {
+            Result operand = static_regex::Evaluate<Operand, Result::LhsRelations(kSymbol, Relations)>(
+                occurrences, pool);
+            result.AddStar(operand);
+            operand.Release(pool);
+        }
+    };
+
+    template <class Lhs, class Rhs>
+    struct Evaluator<Plus<Lhs, Rhs>> {
+        static constexpr char kSymbol = '+';
+        template <int Relations>
+        static void Evaluate(const Occurrences& occurrences, MatrixPool& pool, Result& result) {
+            Result lhs = static_regex::Evaluate<Lhs, Result::LhsRelations(kSymbol, Relations)>(occurrences, pool);
+            Result rhs = static_regex::Evaluate<Rhs, Result::RhsRelations(kSymbol, Relations)>(occurrences, pool);
+            result.AddPlus(lhs, rhs);
+            lhs.Release(pool);
+            rhs.Release(pool);
+        }
+    };
+
+    template <class Lhs, class Rhs>
+    struct Evaluator<Concat<Lhs, Rhs>> {
+        static constexpr char kSymbol = '.';
+        template <int Relations>
+        static void Evaluate(const Occurrences& occurrences, MatrixPool& pool, Result& result) {
+            Result lhs = static_regex::Evaluate<Lhs, Result::LhsRelations(kSymbol, Relations)>(occurrences, pool);
+            Result rhs = static_regex::Evaluate<Rhs, Result::RhsRelations(kSymbol, Relations)>(occurrences, pool);
+            result.AddConcat(lhs, rhs);
+            lhs.Release(pool);
+            rhs.Release(pool);
+        }
+    };
+
+}
+
+template <char... Symbols>
+class StaticRegex {
+    /*
+    Regexpr in reverse polish notation known at compile time, e.g. StaticRegex<'a', '*', 'b', '*', '.'>.
+    It is checked by static_assert and parsed into an operator tree that is a type,
+    so evaluating a word is a fixed sequence of Result operations: nothing is parsed
+    or dispatched by the regexpr symbol at runtime, and there is no stack of Result.
+    Matrices are reused between words as in CompiledRegex::Evaluator.
+    */
+public:
+    static constexpr char kRegexpr[] = {Symbols..., 0};
+    static_assert(static_regex::IsValid(kRegexpr), "regexpr is incorrect");
+    using Tree = typename static_regex::Parse<static_regex::Stack<>, Symbols...>::Type;
+    int GetMaxSubwordLength(const std::string& word);
+private:
+    Occurrences occurrences_;
+    MatrixPool pool_;
+};
+
+template <char... Symbols>
+int StaticRegex<Symbols...>::GetMaxSubwordLength(const std::string& word) {
+
+    // O(m * n^3 / 64), the same answers as RegexprParser::GetMaxSubwordLength
+
+    if (!occurrences_.Reset(word, Alphabet())) {
+        return CompiledRegex::ERROR;
+    }
+
+    Result result = static_regex::Evaluate<Tree, Result::kSubword>(occurrences_, pool_);
+    int max_subword_length = result.subword_indexes.MaxDistance();
+    result.Release(pool_);
+    return max_subword_length;
+
+}
+
+#if __cplusplus >= 202002L
+
+namespace static_regex {
+
+    template <size_t Size>
+    struct FixedString {
+        // string literal as a template argument
+        constexpr FixedString(const char (&string)[Size]) {
+            for (size_t i = 0; i < Size; ++i) {
+                symbols[i] = string[i];
+            }
+        }
+        char symbols[Size];
+    };
+
+    template <FixedString Regexpr, class Indexes = std::make_index_sequence<sizeof(Regexpr.symbols) - 1>>
+    struct FromString;
+    template <FixedString Regexpr, size_t... Indexes>
+    struct FromString<Regexpr, std::index_sequence<Indexes...>> {
+        using Type = StaticRegex<Regexpr.symbols[Indexes]...>;
+    };
+
+}
+
+// StaticRegexOf<"a*b*."> is StaticRegex<'a', '*', 'b', '*', '.'> (C++20)
+template <static_regex::FixedString Regexpr>
+using StaticRegexOf = typename static_regex::FromString<Regexpr>::Type;
+
+#endif
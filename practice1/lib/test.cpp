@@ -3,8 +3,30 @@
 Найти длину самого длинного подслова u, являющегося также подсловом некоторого слова в L.
 */
 
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
+#include <new>
 #include "regexpr_parser.h"
+#include "static_regex.h"
+
+std::atomic<long long> allocations_num(0);
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    ++allocations_num;
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
 
 void PrintTestResult(const std::string& test_name, bool result) {
     std::cout << test_name << (result ? " passed." : " failed.") << "\n";
@@ -114,6 +136,55 @@ void TestAlphabet() {
     parser.SetWord("F");
     result = (parser.GetMaxSubwordLength() == RegexprParser::ERROR);
 
+    // any bytes can be letters, except operator symbols
+    const Alphabet bytes(std::string("xyz\xff\0", 5));
+    result = result && bytes.Contains('\xff') && bytes.Contains('\0') && !bytes.Contains('a')
+        && !Alphabet("a1*+.").Contains('1') && !Alphabet("a1*+.").Contains('*') && Alphabet().Contains('c');
+
+    if (result) {
+        // every engine gives the same answers for the alphabet
+        std::string word = "xyxyzxy\xff";
+        for (int i = 0; i < 70; ++i) {
+            word += "xyzxy\xffxxy"[i * i % 8];
+        }
+        const std::vector<std::pair<std::string, int>> cases = {
+            {"xy.*", 4}, {"x\xff+*", 1}, {"xy.z+*x.", 7}, {"y*\xff.", 2}
+        };
+        for (const auto& test_case : cases) {
+            RegexprParser bytes_parser(test_case.first, word.substr(0, 8));
+            bytes_parser.SetAlphabet(bytes);
+            result = result && bytes_parser.GetMaxSubwordLength() == test_case.second;
+            bytes_parser.SetWord(word);
+            int expected = bytes_parser.GetMaxSubwordLength();
+            result = result && expected >= test_case.second
+                && CompiledRegex(test_case.first, bytes).Evaluate(word) == expected;
+            bytes_parser.SetEngine(RegexprParser::Engine::kAutomaton);
+            result = result && bytes_parser.GetMaxSubwordLength() == expected;
+            bytes_parser.SetWord("");
+            for (char symbol : word) {
+                bytes_parser.AppendChar(symbol);
+            }
+            result = result && bytes_parser.CurrentMaxSubwordLength() == expected;
+        }
+        parser.SetRegexpr("xy.*");
+        parser.SetWord("xy");
+        result = result && parser.GetMaxSubwordLength() == RegexprParser::ERROR;
+    }
+
+    if (result) {
+        // one bitset per symbol of the word
+        Occurrences occurrences;
+        // a default-constructed object is the empty word
+        result = occurrences.Length() == 0 && occurrences.WordsNum() == 0 && occurrences.Positions('a') == nullptr;
+        std::string word(130, 'a');
+        word[3] = word[64] = word[129] = 'c';
+        result = result && occurrences.Reset(word, Alphabet()) && occurrences.Length() == 130 && occurrences.WordsNum() == 3
+            && occurrences.Positions('b') == nullptr && occurrences.Positions('c')[0] == (uint64_t(1) << 3)
+            && occurrences.Positions('c')[1] == 1 && occurrences.Positions('c')[2] == 2
+            && occurrences.Positions('a')[0] == ~(uint64_t(1) << 3)
+            && !occurrences.Reset("abF", Alphabet());
+    }
+
     PrintTestResult("TestAlphabet", result);
 
 }
@@ -141,12 +212,352 @@ void TestError() {
 
 }
 
+void TestCompiled() {
+
+    bool result = true;
+
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        {"abacaba......", "abacaba"},
+        {"a*b*.", "aaabbb"},
+        {"a*cb*..", "bbaaacbbbcca"},
+        {"ab+c.aba.*.bac.+.+*", "babc"},
+        {"acb..bab.c.*.ab.ba.+.+*a.", "abbaa"},
+        {"a*a.", "cbcbcbc"},
+        {"ab.ba..", "bb"},
+        {"ab+", ""},
+        {"1a+", "F"}
+    };
+
+    std::vector<std::string> words;
+    for (const auto& test_case : cases) {
+        CompiledRegex regex(test_case.first);
+        int expected = RegexprParser(test_case.first, test_case.second).GetMaxSubwordLength();
+        result = result && regex.IsValid() && regex.Evaluate(test_case.second) == expected;
+        words.push_back(test_case.second);
+    }
+
+    if (result) {
+        // one regexpr, many words, several threads
+        CompiledRegex regex("ab+c.aba.*.bac.+.+*");
+        std::vector<int> answers = regex.EvaluateAll(words, 3);
+        for (size_t i = 0; i < words.size(); ++i) {
+            RegexprParser parser("ab+c.aba.*.bac.+.+*", words[i]);
+            result = result && answers[i] == parser.GetMaxSubwordLength();
+        }
+    }
+
+    if (result) {
+        result = !CompiledRegex("").IsValid() && !CompiledRegex("a+").IsValid()
+            && !CompiledRegex("ab").IsValid() && !CompiledRegex("*").IsValid()
+            && CompiledRegex("a.").Evaluate("a") == RegexprParser::ERROR;
+    }
+
+    PrintTestResult("TestCompiled", result);
+
+}
+
+void TestParallel() {
+
+    bool result = true;
+
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        {"abacaba......", "abacaba"},
+        {"a*cb*..", "bbaaacbbbcca"},
+        {"ab+c.aba.*.bac.+.+*", "babc"},
+        {"acb..bab.c.*.ab.ba.+.+*a.", "abbaa"},
+        {"acb..bab.c.*.ab.ba.+.+*a.", "abbaaabbbabbacbabbcbabcbcbbabababacbbbcbabcbbaabcbcb"},
+        {"ab.ba..", "bb"},
+        {"a.", "a"},
+        {"1", "F"}
+    };
+
+    RegexprParser parallel_parser("", "");
+    parallel_parser.SetThreadsNum(4);
+    for (const auto& test_case : cases) {
+        RegexprParser parser(test_case.first, test_case.second);
+        parallel_parser.SetRegexpr(test_case.first);
+        parallel_parser.SetWord(test_case.second);
+        result = result && parallel_parser.GetMaxSubwordLength() == parser.GetMaxSubwordLength();
+        if (result && parser.GetMaxSubwordLength() != RegexprParser::ERROR) {
+            result = parallel_parser.GetParsedRegexpr() == parser.GetParsedRegexpr();
+        }
+    }
+
+    PrintTestResult("TestParallel", result);
+
+}
+
+void TestAutomaton() {
+
+    bool result = true;
+
+    // cross-checking both engines
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        {"abacaba......", "abacaba"},
+        {"a*b*.", "aaabbb"},
+        {"a*cb*..", "bbaaacbbbcca"},
+        {"ab+c.aba.*.bac.+.+*", "babc"},
+        {"acb..bab.c.*.ab.ba.+.+*a.", "abbaa"},
+        {"a*a.", "cbcbcbc"},
+        {"ab.ba..", "bb"},
+        {"a", "cbcbcbc"},
+        {"ab.", "cccccccc"},
+        {"ab+", "cccccccc"},
+        {"caca*cc*aa.b.+...*.+", "cbacbabbbbcccababcbcacbbbcbcbbcb"},
+        {"a", ""},
+        {"1a+", ""},
+        {"", ""},
+        {"1", "F"},
+        {"*", "a"},
+        {"a+", "a"},
+        {"a.", "a"}
+    };
+
+    RegexprParser parser("", "");
+    parser.SetEngine(RegexprParser::Engine::kAutomaton);
+    for (const auto& test_case : cases) {
+        parser.SetRegexpr(test_case.first);
+        parser.SetWord(test_case.second);
+        int expected = RegexprParser(test_case.first, test_case.second).GetMaxSubwordLength();
+        result = result && parser.GetMaxSubwordLength() == expected;
+    }
+
+    PrintTestResult("TestAutomaton", result);
+
+}
+
+void TestAllocations() {
+
+    bool result = true;
+
+    // after the first word, evaluating words of the same length doesn't allocate memory
+    CompiledRegex regex("acb..bab.c.*.ab.ba.+.+*a.");
+    CompiledRegex::Evaluator evaluator(regex);
+    std::vector<std::string> words = {
+        "abbaaabbbabbacbabbcbabcbcbbabababacbbbcbabcbbaabcbcbabab",
+        "cbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcbcb",
+        "abababababababababababababababababababababababababababab"
+    };
+    std::vector<int> answers(words.size());
+    evaluator.Evaluate(words[0]);
+
+    long long allocations_before = allocations_num;
+    for (size_t i = 0; i < words.size(); ++i) {
+        answers[i] = evaluator.Evaluate(words[i]);
+    }
+    result = (allocations_num == allocations_before);
+
+    for (size_t i = 0; i < words.size() && result; ++i) {
+        result = answers[i] == RegexprParser("acb..bab.c.*.ab.ba.+.+*a.", words[i]).GetMaxSubwordLength();
+    }
+
+    PrintTestResult("TestAllocations", result);
+
+}
+
+void TestIncremental() {
+
+    bool result = true;
+
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        {"abacaba......", "abacaba"},
+        {"a*b*.", "aaabbb"},
+        {"a*cb*..", "bbaaacbbbcca"},
+        {"ab+c.aba.*.bac.+.+*", "babc"},
+        {"acb..bab.c.*.ab.ba.+.+*a.", "abbaaabbbabbacbabbcbabcbcbbabababacbbbcbabcbbaabcbcbababbcabcbabbabcabcbc"},
+        {"caca*cc*aa.b.+...*.+", "cbacbabbbbcccababcbcacbbbcbcbbcb"},
+        {"a*a.", "cbcbcbc"},
+        {"ab.ba..", "bb"}
+    };
+
+    // every prefix of the word, symbols are given one by one
+    for (const auto& test_case : cases) {
+        RegexprParser parser(test_case.first, "");
+        result = result && parser.CurrentMaxSubwordLength() == 0;
+        for (size_t i = 0; i < test_case.second.length() && result; ++i) {
+            parser.AppendChar(test_case.second[i]);
+            RegexprParser full_parser(test_case.first, test_case.second.substr(0, i + 1));
+            result = parser.CurrentMaxSubwordLength() == full_parser.GetMaxSubwordLength()
+                && parser.GetWord() == full_parser.GetWord();
+        }
+    }
+
+    if (result) {
+        RegexprParser parser("a*b*.", "aab");
+        parser.AppendChar('b');
+        result = parser.CurrentMaxSubwordLength() == 4;
+        parser.AppendChar('F');
+        result = result && parser.CurrentMaxSubwordLength() == RegexprParser::ERROR;
+        parser.SetRegexpr("ab+");
+        result = result && parser.CurrentMaxSubwordLength() == RegexprParser::ERROR;
+        parser.SetWord("ab");
+        result = result && parser.CurrentMaxSubwordLength() == 1;
+        parser.SetRegexpr("a+");
+        result = result && parser.CurrentMaxSubwordLength() == RegexprParser::ERROR;
+    }
+
+    PrintTestResult("TestIncremental", result);
+
+}
+
+void TestShared() {
+
+    bool result = true;
+
+    // equal subexpressions are one node
+    result = CompiledRegex("ab.ab.+").NodesNum() == 4 && CompiledRegex("aa.").NodesNum() == 2
+        && CompiledRegex("ab.ba.+ab.ba.+.").NodesNum() == 6 && CompiledRegex("ab.ba..").NodesNum() == 5
+        && CompiledRegex("acb..bab.c.*.ab.ba.+.+*a.").NodesNum() == 15;
+
+    // (x . x) with x = (ab. + ba.)* doubled 12 times: 4096 copies of x, evaluated once each
+    std::string regexpr = "ab.ba.+*";
+    for (int i = 0; i < 12; ++i) {
+        regexpr = regexpr + regexpr + '.';
+    }
+    std::string word = "abbaabababbacabbaabab";
+    CompiledRegex regex(regexpr);
+    RegexprParser parser(regexpr, word);
+    RegexprParser automaton_parser(regexpr, word);
+    automaton_parser.SetEngine(RegexprParser::Engine::kAutomaton);
+    result = result && regex.NodesNum() == 6 + 12 && parser.GetMaxSubwordLength() == 12
+        && automaton_parser.GetMaxSubwordLength() == 12 && regex.Evaluate(word) == 12;
+
+    PrintTestResult("TestShared", result);
+
+}
+
+void TestStatic() {
+
+    bool result = true;
+
+    const std::vector<std::string> words = {
+        "abacaba", "aaabbb", "bbaaacbbbcca", "babc", "abbaa", "cbcbcbc", "bb", "",
+        "abbaaabbbabbacbabbcbabcbcbbabababacbbbcbabcbbaabcbcbababbcabcbabbabcabcbc"
+    };
+
+    // the same answers as RegexprParser, words of any length one after another
+    StaticRegex<'a', '*', 'c', 'b', '*', '.', '.'> star_regex;
+    StaticRegex<'a', 'b', '+', 'c', '.', 'a', 'b', 'a', '.', '*', '.', 'b', 'a', 'c', '.', '+', '.', '+', '*'> nested_regex;
+    StaticRegex<'1', 'a', '+'> epsilon_regex;
+    for (const auto& word : words) {
+        result = result
+            && star_regex.GetMaxSubwordLength(word) == RegexprParser("a*cb*..", word).GetMaxSubwordLength()
+            && nested_regex.GetMaxSubwordLength(word) == RegexprParser("ab+c.aba.*.bac.+.+*", word).GetMaxSubwordLength()
+            && epsilon_regex.GetMaxSubwordLength(word) == RegexprParser("1a+", word).GetMaxSubwordLength();
+    }
+
+    // matrices are reused: a word that isn't longer than the previous ones doesn't allocate memory
+    long long allocations_before = allocations_num;
+    nested_regex.GetMaxSubwordLength(words[2]);
+    result = result && allocations_num == allocations_before;
+
+    result = result && star_regex.GetMaxSubwordLength("aF") == RegexprParser::ERROR;
+
+#if __cplusplus >= 202002L
+    StaticRegexOf<"acb..bab.c.*.ab.ba.+.+*a."> string_regex;
+    for (const auto& word : words) {
+        result = result && string_regex.GetMaxSubwordLength(word)
+            == RegexprParser("acb..bab.c.*.ab.ba.+.+*a.", word).GetMaxSubwordLength();
+    }
+#endif
+
+    PrintTestResult("TestStatic", result);
+
+}
+
+void TestDemand() {
+
+    bool result = true;
+
+    // nodes compute only the relations their parents need
+    const int kAll = Result::kAllRelations;
+    CompiledRegex concat("ab.");
+    result = concat.Relations(0) == (Result::kSubword | Result::kSuffix)
+        && concat.Relations(1) == (Result::kSubword | Result::kPrefix) && concat.Relations(2) == Result::kSubword;
+    CompiledRegex nested("abc..");
+    result = result && nested.Relations(4) == Result::kSubword
+        && nested.Relations(3) == (Result::kSubword | Result::kPrefix)
+        && nested.Relations(0) == (Result::kSubword | Result::kSuffix) && nested.Relations(1) == kAll
+        && nested.Relations(2) == (Result::kSubword | Result::kPrefix);
+    CompiledRegex star("ab.*c+");
+    result = result && star.Relations(2) == kAll && star.Relations(3) == kAll
+        && star.Relations(4) == Result::kSubword && star.Relations(5) == Result::kSubword;
+
+    // the same answers as the automaton, which doesn't use the relations
+    const std::vector<std::string> regexprs = {
+        "ab.", "abc..", "ab.*c+", "a*b*.c.", "ab+c.aba.*.bac.+.+*", "acb..bab.c.*.ab.ba.+.+*a.", "1a.b*."
+    };
+    const std::vector<std::string> words = {"abacaba", "aaabbbcab", "bbaaacbbbcca", "", "cbcbcbc"};
+    for (const auto& regexpr : regexprs) {
+        for (const auto& word : words) {
+            RegexprParser automaton_parser(regexpr, word);
+            automaton_parser.SetEngine(RegexprParser::Engine::kAutomaton);
+            result = result && CompiledRegex(regexpr).Evaluate(word) == automaton_parser.GetMaxSubwordLength();
+        }
+    }
+
+    PrintTestResult("TestDemand", result);
+
+}
+
+void TestBands() {
+
+    bool result = true;
+
+    // upper bound of the answer: the longest word of the language
+    result = CompiledRegex("abc..ab+.").MaxWordLength() == 4 && CompiledRegex("ab.*").MaxWordLength() == -1
+        && CompiledRegex("1*a+").MaxWordLength() == 1 && CompiledRegex("ab.*1.c.").MaxWordLength() == -1;
+
+    // (ab)^100 c (ab)^50: the answer 200 is found with bands 64, 128, 256
+    std::string word;
+    for (int i = 0; i < 150; ++i) {
+        word += (i == 100 ? "cab" : "ab");
+    }
+    CompiledRegex regex("ab.*");
+    CompiledRegex::Evaluator evaluator(regex);
+    result = result && evaluator.EvaluateByBands(word) == 200 && evaluator.Evaluate(word) == 200
+        && evaluator.Evaluate(word, 64) == 64 && evaluator.Evaluate(word, 1000) == 200
+        && evaluator.Evaluate(word, 0) == 0 && evaluator.HasSubword(word, 200) && !evaluator.HasSubword(word, 201)
+        && evaluator.HasSubword(word, 0) && !evaluator.HasSubword("abF", 1) && evaluator.Evaluate("abF", 1) == RegexprParser::ERROR;
+
+    // the same answers as the other engines
+    const std::vector<std::string> regexprs = {"ab+c.aba.*.bac.+.+*", "acb..bab.c.*.ab.ba.+.+*a.", "a*b*.", "abc..ab+."};
+    const std::vector<std::string> words = {"abacaba", word, "", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaabbbbb"};
+    for (const auto& regexpr : regexprs) {
+        for (const auto& current_word : words) {
+            RegexprParser bands_parser(regexpr, current_word);
+            bands_parser.SetEngine(RegexprParser::Engine::kBands);
+            RegexprParser automaton_parser(regexpr, current_word);
+            automaton_parser.SetEngine(RegexprParser::Engine::kAutomaton);
+            RegexprParser parser(regexpr, current_word);
+            int answer = parser.GetMaxSubwordLength();
+            result = result && bands_parser.GetMaxSubwordLength() == answer
+                && automaton_parser.GetMaxSubwordLength(70) == std::min(answer, 70)
+                && parser.GetMaxSubwordLength(70) == std::min(answer, 70)
+                && parser.HasSubwordOfLength(answer) && !parser.HasSubwordOfLength(answer + 1)
+                && automaton_parser.HasSubwordOfLength(answer) && !automaton_parser.HasSubwordOfLength(answer + 1);
+        }
+    }
+
+    PrintTestResult("TestBands", result);
+
+}
+
 void LaunchAllTests() {
     TestNormal();
     TestEmptyWord();
     TestEmptyExpr();
     TestAlphabet();
     TestError();
+    TestCompiled();
+    TestParallel();
+    TestAutomaton();
+    TestAllocations();
+    TestIncremental();
+    TestShared();
+    TestStatic();
+    TestDemand();
+    TestBands();
 }
 
 int main() {
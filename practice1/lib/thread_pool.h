@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    /*
+    Work-stealing thread pool.
+    Every worker has its own deque: tasks submitted by a worker go to the back of its deque
+    and are taken from the back (the most recent, cache-hot task first), idle workers steal
+    from the front of other deques. Tasks submitted from outside go to a shared deque.
+    WaitFor lets a task wait for its subtasks while executing other tasks, so fork/join
+    recursion never blocks a worker.
+    */
+public:
+    explicit ThreadPool(int threads_num = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    void Submit(std::function<void()> task);
+    void Wait();  // blocks until every submitted task is finished, must not be called from a task
+    void WaitFor(const std::atomic<int>& pending);  // runs queued tasks until pending becomes 0
+    int Size() const;
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    int CurrentQueue() const;
+    bool RunTask(int queue_index);
+    void Work(int queue_index);
+    std::vector<std::unique_ptr<TaskQueue>> queues_;  // one per worker, the last one is shared
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable task_added_;
+    std::condition_variable tasks_finished_;
+    std::atomic<int> queued_tasks_;
+    std::atomic<int> unfinished_tasks_;
+    bool stopping_ = false;
+    inline static thread_local const ThreadPool* current_pool_ = nullptr;
+    inline static thread_local int current_queue_ = -1;
+};
+
+ThreadPool::ThreadPool(int threads_num) : queued_tasks_(0), unfinished_tasks_(0) {
+    if (threads_num <= 0) {
+        // 0 means "as many as the hardware has"
+        threads_num = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i <= threads_num; ++i) {
+        queues_.push_back(std::make_unique<TaskQueue>());
+    }
+    for (int i = 0; i < threads_num; ++i) {
+        workers_.emplace_back(&ThreadPool::Work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    task_added_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    // counters go first, so that they can't drop to 0 while the task is being run
+    ++unfinished_tasks_;
+    ++queued_tasks_;
+    TaskQueue& queue = *queues_[CurrentQueue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        // taking the lock so that a worker can't miss the notification between its check and its wait
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    task_added_.notify_one();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    tasks_finished_.wait(lock, [this] { return unfinished_tasks_ == 0; });
+}
+
+void ThreadPool::WaitFor(const std::atomic<int>& pending) {
+    int queue_index = CurrentQueue();
+    while (pending > 0) {
+        if (!RunTask(queue_index)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+int ThreadPool::Size() const {
+    return workers_.size();
+}
+
+int ThreadPool::CurrentQueue() const {
+    // workers use their own queues, other threads use the shared one
+    return current_pool_ == this ? current_queue_ : queues_.size() - 1;
+}
+
+bool ThreadPool::RunTask(int queue_index) {
+
+    std::function<void()> task;
+    int queues_num = queues_.size();
+
+    // own queue from the back, then the others (starting with the shared one) from the front
+    for (int i = 0; i < queues_num && !task; ++i) {
+        TaskQueue& queue = *queues_[(queue_index + queues_num - i) % queues_num];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+
+    --queued_tasks_;
+    task();
+    if (--unfinished_tasks_ == 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        tasks_finished_.notify_all();
+    }
+    return true;
+
+}
+
+void ThreadPool::Work(int queue_index) {
+    current_pool_ = this;
+    current_queue_ = queue_index;
+    while (true) {
+        if (RunTask(queue_index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        task_added_.wait(lock, [this] { return stopping_ || queued_tasks_ > 0; });
+        if (stopping_ && queued_tasks_ == 0) {
+            return;
+        }
+    }
+}
@@ -1,7 +1,20 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <numeric>
+#include <queue>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 
 struct GrammarRule {
@@ -42,11 +55,62 @@ struct Grammar {
 
 };
 
+class CompiledGrammar {
+    // CF grammar prepared for Earley algorithm.
+    // Nonterminals are interned to dense ids 0, 1, ..., terminal c has id -1 - (unsigned char)c,
+    // so any number of named nonterminals is possible and a symbol is checked by its sign.
+    // Rule bodies are stored one after another in one array, every body ends with kEnd.
+    // Rules are grouped by their left side, the augmented start rule (S' -> S) is added by SetStart.
+    // Nullable (A =>* eps) and productive (A =>* some word) nonterminals are kept up to date
+    // while rules are added.
+public:
+
+    static constexpr int kEnd = INT_MIN;  // symbol after the last one of a rule body
+
+    CompiledGrammar() = default;
+    explicit CompiledGrammar(const Grammar& grammar);  // rule i of grammar gets id i
+
+    int AddNonterminal(const std::string& name);  // id of nonterminal, it is added if it is new
+    static int AddTerminal(char symbol) { return -1 - static_cast<unsigned char>(symbol); }
+    int AddRule(int from, const std::vector<int>& to);  // returns rule id
+    void SetStart(int nonterminal);
+
+    static bool IsNonterminal(int symbol) { return symbol >= 0; }
+    int NonterminalsNum() const { return rules_by_lhs_.size(); }
+    int RulesNum() const { return rule_lhs_.size(); }
+    int RuleLhs(int rule) const { return rule_lhs_[rule]; }
+    int RuleLength(int rule) const { return rule_begin_[rule + 1] - rule_begin_[rule] - 1; }
+    // symbol of rule body at position index, kEnd if index is the body length
+    int Symbol(int rule, int index) const { return bodies_[rule_begin_[rule] + index]; }
+    const std::vector<int>& RulesOf(int nonterminal) const { return rules_by_lhs_[nonterminal]; }
+    bool IsNullable(int nonterminal) const { return nullable_[nonterminal]; }
+    // rules with unproductive symbols are never a part of a derivation of a word
+    bool IsProductiveRule(int rule) const { return RuleHas(productive_, rule, true); }
+    int StartRule() const { return start_rule_; }
+
+private:
+
+    std::unordered_map<std::string, int> nonterminal_ids_;
+    std::vector<std::vector<int>> rules_by_lhs_;
+    std::vector<int> rule_lhs_;
+    std::vector<int> rule_begin_ = {0};  // body of rule r is bodies_[rule_begin_[r], rule_begin_[r + 1])
+    std::vector<int> bodies_;
+    std::vector<bool> nullable_;
+    std::vector<bool> productive_;
+    int start_rule_ = -1;
+
+    int NewNonterminal();
+    // all body symbols are marked nonterminals (or terminals, if terminals is true)
+    bool RuleHas(const std::vector<bool>& nonterminals, int rule, bool terminals) const;
+    void Propagate(std::vector<bool>& nonterminals, int rule, bool terminals);
+
+};
+
 struct Configuration {
-    // Configuration for Earley algorithm: grammar rule, index, symbols_read
+    // Configuration for Earley algorithm: grammar rule id, index, symbols_read
 
-    explicit Configuration(GrammarRule rule, int index, int symbols_read)
-        : rule(std::move(rule)), index(index), symbols_read(symbols_read) {}
+    explicit Configuration(int rule, int index, int symbols_read)
+        : rule(rule), index(index), symbols_read(symbols_read) {}
 
     bool operator==(const Configuration& other) const {
         return (rule == other.rule && index == other.index && symbols_read == other.symbols_read);
@@ -55,7 +119,7 @@ struct Configuration {
         return !(*this == other);
     }
 
-    GrammarRule rule;
+    int rule;
     int index;
     int symbols_read;
 
@@ -63,133 +127,1323 @@ struct Configuration {
 
 struct ConfigurationHash {
     size_t operator()(const Configuration& config) const {
-        return RuleHash()(config.rule) + std::hash<int>()(config.index) + std::hash<int>()(config.symbols_read);
+        // all three fields are mixed, so configurations that differ only in origin don't collide
+        uint64_t hash = (uint64_t(uint32_t(config.rule)) << 32 | uint32_t(config.index))
+            ^ uint64_t(uint32_t(config.symbols_read)) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 31;
+        hash *= 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 29;
+        return hash;
     }
 };
 
+class Arena {
+    // Allocator for objects that are freed all together with the arena.
+    // Objects must be trivially destructible, their destructors are never called.
+public:
+
+    template <class T, class... Args>
+    T* New(Args&&... args);
+
+private:
+
+    static const size_t kBlockSize = 1 << 16;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t used_ = kBlockSize;  // bytes used in the last block
+
+};
+
+class Forest {
+    // Binarized shared packed parse forest (SPPF) of a word.
+    // Symbol node (X, i, j): X derives word[i, j), its alternatives are rules of X,
+    // terminal nodes have no alternatives.
+    // Item node (A -> alpha.beta, i, j): alpha derives word[i, j), an alternative with pivot k
+    // splits it into item node (A -> alpha'.Xbeta, i, k) (none if alpha' is empty) and symbol node (X, k, j).
+    // Nodes and alternatives are shared by all derivations, so the forest of a word of length n
+    // has O(n^2) nodes and O(n^3) alternatives even if the number of derivations is exponential.
+public:
+
+    typedef uint64_t Count;
+    static constexpr Count kInfinity = UINT64_MAX;  // also used for counts that don't fit
+
+    struct Node;
+    struct Packed {
+        int pivot;  // rule for alternatives of symbol nodes
+        const Node* left;
+        const Node* right;
+        Packed* next;
+    };
+    struct Node {
+        int symbol;  // for symbol nodes
+        int rule;  // -1 for symbol nodes
+        int index;
+        int begin;
+        int end;
+        Packed* alternatives;
+        int number;  // in creation order
+        int height;  // of the lowest derivation tree
+        Count derivations_num;
+    };
+
+    const Node* Root() const { return root_; }  // start symbol node, nullptr if word isn't deducible
+    Count DerivationsNum() const { return root_ == nullptr ? 0 : root_->derivations_num; }
+    // k-th leftmost derivation as rule ids, k < DerivationsNum()
+    std::vector<int> Derivation(Count k) const;
+    size_t NodesNum() const { return nodes_.size(); }
+    size_t PackedNum() const { return packed_num_; }
+
+    class DerivationIterator {
+        // derivations are unranked one by one, so the first ones are got without the rest
+    public:
+        DerivationIterator(const Forest* forest, Count index) : forest_(forest), index_(index) {}
+        std::vector<int> operator*() const { return forest_->Derivation(index_); }
+        DerivationIterator& operator++() { ++index_; return *this; }
+        bool operator==(const DerivationIterator& other) const { return index_ == other.index_; }
+        bool operator!=(const DerivationIterator& other) const { return index_ != other.index_; }
+    private:
+        const Forest* forest_;
+        Count index_;
+    };
+    DerivationIterator begin() const { return DerivationIterator(this, 0); }
+    DerivationIterator end() const { return DerivationIterator(this, DerivationsNum()); }
+
+    // building, used by Earley
+    Node* SymbolNode(int symbol, int begin, int end);
+    Node* ItemNode(int rule, int index, int begin, int end);
+    void AddAlternative(Node* node, int pivot, const Node* left, const Node* right);
+    void Finish(const Node* root);
+
+private:
+
+    struct NodeKey {
+        bool operator==(const NodeKey& other) const {
+            return symbol == other.symbol && rule == other.rule && index == other.index
+                && begin == other.begin && end == other.end;
+        }
+        int symbol;
+        int rule;
+        int index;
+        int begin;
+        int end;
+    };
+    struct NodeKeyHash {
+        size_t operator()(const NodeKey& key) const;
+    };
+
+    Node* GetNode(const NodeKey& key);
+    void CountHeights();
+    void CountDerivations();
+
+    Arena arena_;
+    std::vector<Node*> nodes_;
+    std::unordered_map<NodeKey, Node*, NodeKeyHash> node_by_key_;
+    std::unordered_set<uint64_t> alternative_keys_;  // node number and pivot
+    size_t packed_num_ = 0;
+    const Node* root_ = nullptr;
+
+};
+
 namespace Earley {
-    typedef std::vector< std::unordered_set<Configuration, ConfigurationHash> > ConfigTable;
-    void Scan(ConfigTable& D, int j, const std::string& word);
-    int Predict(ConfigTable& D, int j, const Grammar& grammar);
-    int Complete(ConfigTable& D, int j);
+
+    class ConfigTable;
+
+    struct IndexRange {
+        const int* first;
+        const int* last;
+        const int* begin() const { return first; }
+        const int* end() const { return last; }
+        size_t size() const { return last - first; }
+    };
+
+    enum class ItemSource {
+        kScan,
+        kPredict,
+        kComplete  // the dot is moved over a nonterminal, also over a nullable one when it is predicted
+    };
+
+    struct NoStats {
+        // Stats policy that records nothing: every call is empty and is compiled out.
+        // Recognition functions take the policy as a template parameter, see Stats for the calls.
+        void BeginColumn(int /*j*/) {}
+        void EndColumn(int /*j*/) {}
+        void AddItem(int /*j*/, ItemSource /*source*/, int /*rule*/) {}
+        void AddRound(int /*j*/) {}
+        void AddDuplicate(int /*j*/) {}
+        void AddProbes(int /*j*/, size_t /*probes*/) {}
+    };
+
+    class Stats {
+        // Stats policy that records the work done for every column of Earley table:
+        // configurations added by Scan, Predict and Complete, rounds of the Predict/Complete fixpoint
+        // (configurations added while the previous round was processed make the next one),
+        // rejected duplicates, probes of the open-addressing table and wall time.
+        // Configurations are also counted by rule, to find rules that blow up the table.
+    public:
+
+        struct ColumnStats {
+            size_t items[3] = {0, 0, 0};  // by ItemSource
+            size_t rounds = 0;
+            size_t duplicates = 0;
+            size_t probes = 0;
+            double ms = 0;
+        };
+
+        void BeginColumn(int j);
+        void EndColumn(int j);
+        void AddItem(int j, ItemSource source, int rule);
+        void AddRound(int j) { ++Column(j).rounds; }
+        void AddDuplicate(int j) { ++Column(j).duplicates; }
+        void AddProbes(int j, size_t probes) { Column(j).probes += probes; }
+
+        const std::vector<ColumnStats>& Columns() const { return columns_; }
+        const std::vector<size_t>& ItemsByRule() const { return items_by_rule_; }  // by CompiledGrammar rule id
+        // {"columns": [{"column": j, "scan": ..., "predict": ..., "complete": ..., "rounds": ...,
+        //               "duplicates": ..., "probes": ..., "ms": ...}, ...],
+        //  "rules": [{"rule": id, "items": ...}, ...]}, only rules with configurations are listed
+        void WriteJson(std::ostream& out) const;
+
+    private:
+
+        ColumnStats& Column(int j);
+
+        std::vector<ColumnStats> columns_;
+        std::vector<size_t> items_by_rule_;
+        std::chrono::steady_clock::time_point column_start_;
+
+    };
+
+    class Column {
+        // Column j of Earley table, configurations are in the order they were added.
+        // It is a view: configurations are stored by the table and are read by value.
+    public:
+
+        class const_iterator {
+        public:
+            const_iterator(const ConfigTable* table, size_t position) : table_(table), position_(position) {}
+            Configuration operator*() const;
+            const_iterator& operator++() { ++position_; return *this; }
+            bool operator==(const const_iterator& other) const { return position_ == other.position_; }
+            bool operator!=(const const_iterator& other) const { return position_ != other.position_; }
+        private:
+            const ConfigTable* table_;
+            size_t position_;  // in the table
+        };
+
+        Column(const ConfigTable* table, int j) : table_(table), j_(j) {}
+
+        const_iterator begin() const;
+        const_iterator end() const;
+        size_t size() const;
+        Configuration operator[](size_t index) const;
+        const_iterator find(const Configuration& config) const;  // O(1) in the open column, O(size) in others
+        size_t Bytes() const;  // memory the column takes in the table
+
+    private:
+
+        const ConfigTable* table_;
+        int j_;
+
+    };
+
+    class ConfigTable {
+        // Earley table in one arena: configurations of all columns are stored column after column
+        // in three arrays (rule, index, symbols_read), 12 bytes per configuration.
+        // Columns are filled in order, adding to column j closes every column before it.
+        // Only the open column has an open-addressing table of indexes to find duplicates,
+        // the next column reuses it. A closed column keeps the indexes of configurations waiting
+        // for nonterminals, grouped by the nonterminal, and memoized Leo's transitive items for them.
+        // So the memory of a column is known exactly and nothing is allocated per column.
+    public:
+
+        static constexpr int kUnknown = -2;  // rule of a transitive item that isn't computed yet
+
+        explicit ConfigTable(const CompiledGrammar& grammar, int columns_num = 0)
+            : grammar_(&grammar), columns_num_(columns_num) {}
+
+        int size() const { return columns_num_; }
+        Column operator[](int j) const { return Column(this, j); }
+        Column back() const { return Column(this, columns_num_ - 1); }
+        void AddColumn() { ++columns_num_; }
+        void Truncate(int columns_num);  // keeps first columns_num columns, they must be closed
+        // adds configuration to column j (not closed yet) if it isn't there, returns if it was added
+        bool emplace(int j, int rule, int index, int symbols_read) {
+            NoStats stats;
+            return emplace(j, rule, index, symbols_read, stats);
+        }
+        // the same, probes and a rejected duplicate are recorded to stats
+        template <class Stats>
+        bool emplace(int j, int rule, int index, int symbols_read, Stats& stats);
+        void CloseColumns(int j);  // columns up to j are closed
+
+        // indexes of configurations (A -> alpha.Bbeta, i) of closed column k waiting for nonterminal B
+        IndexRange Waiting(int k, int nonterminal) const;
+        // memoized Leo's transitive item of closed column k for nonterminal, nullptr if nothing waits for it
+        Configuration* Transitive(int k, int nonterminal);
+
+        size_t ColumnBytes(int j) const;
+        size_t Bytes() const;  // allocated for the whole table
+
+    private:
+
+        friend class Column;
+        friend class Column::const_iterator;
+
+        struct WaitingList {
+            int nonterminal;
+            size_t begin;  // in waiting_
+            Configuration transitive;
+        };
+
+        size_t Begin(int j) const { return j <= open_ ? column_begin_[j] : rules_.size(); }
+        size_t End(int j) const { return j < open_ ? column_begin_[j + 1] : rules_.size(); }
+        size_t WaitingBegin(int j) const;  // first index of closed column j in waiting_
+        Configuration At(size_t position) const {
+            return Configuration(rules_[position], indexes_[position], symbols_read_[position]);
+        }
+        const WaitingList* FindList(int k, int nonterminal) const;
+        // with config or empty, probes is increased by the number of slots looked at
+        size_t FindSlot(const Configuration& config, size_t& probes) const;
+        void Grow();
+
+        const CompiledGrammar* grammar_;
+        int columns_num_;
+        int open_ = 0;  // first column that isn't closed
+        std::vector<int> rules_;
+        std::vector<int> indexes_;
+        std::vector<int> symbols_read_;
+        std::vector<size_t> column_begin_ = {0};  // for columns up to open_
+        std::vector<size_t> lists_begin_ = {0};  // first waiting list of column, for columns up to open_
+        std::vector<WaitingList> lists_;
+        std::vector<int> waiting_;  // indexes in their columns
+        std::vector<int> slots_;  // indexes in the open column, -1 in empty slots, size is a power of 2
+        std::vector<std::pair<int, int>> closing_;  // nonterminal and index, reused by CloseColumns
+
+    };
+
+    ConfigTable MakeTable(const CompiledGrammar& grammar, int size);
+    // with forest every new derivation step is also added to it
+    void Scan(ConfigTable& D, int j, const std::string& word, const CompiledGrammar& grammar,
+              Forest* forest = nullptr);
+    void Scan(ConfigTable& D, int j, char symbol, const CompiledGrammar& grammar, Forest* forest = nullptr);
+    int Close(ConfigTable& D, int j, const CompiledGrammar& grammar, bool leo = true, Forest* forest = nullptr);
+    // the same with a stats policy (NoStats or Stats)
+    template <class Stats>
+    void Scan(ConfigTable& D, int j, char symbol, const CompiledGrammar& grammar, Forest* forest, Stats& stats);
+    template <class Stats>
+    int Close(ConfigTable& D, int j, const CompiledGrammar& grammar, bool leo, Forest* forest, Stats& stats);
+    Configuration Transitive(ConfigTable& D, int k, int nonterminal, const CompiledGrammar& grammar);
 }
 
+class StreamRecognizer {
+    // Earley recognizer for a word given symbol by symbol,
+    // every symbol costs only building its column
+public:
+
+    explicit StreamRecognizer(const CompiledGrammar& grammar, bool leo = true);
+
+    void Feed(char symbol);
+    bool IsAcceptedSoFar() const;  // symbols fed so far are a word of the grammar
+    // symbols fed so far are a prefix of some word of the grammar:
+    // the last column isn't empty (rules with unproductive symbols are never predicted,
+    // so every configuration can be completed), once it is empty nothing is built any more
+    bool IsViablePrefix() const { return D_.back().size() != 0; }
+    size_t Length() const { return length_; }
+    const Earley::ConfigTable& Table() const { return D_; }  // columns built so far
+
+private:
+
+    const CompiledGrammar* grammar_;
+    bool leo_;
+    Earley::ConfigTable D_;
+    size_t length_ = 0;
+
+};
+
 class Algo {
     // Earley algorithm parser
 public:
 
-    explicit Algo(Grammar grammar) : grammar_(std::move(grammar)) {}
+    explicit Algo(const Grammar& grammar) : grammar_(grammar) {}
+    explicit Algo(CompiledGrammar grammar) : grammar_(std::move(grammar)) {}
 
     bool IsDeducible(const std::string& word);  // check if word can be determined by grammar
+    // the same, the work for every column is recorded to stats (Earley::Stats),
+    // with Earley::NoStats nothing is recorded and it is as fast as IsDeducible
+    template <class Stats>
+    bool IsDeducible(const std::string& word, Stats& stats);
+    Forest Parse(const std::string& word);  // all derivations of word, Leo's optimization isn't used
+    // IsDeducible for every word, columns of common prefixes are built once;
+    // threads_num = 0 means one thread per core
+    std::vector<bool> AreDeducible(const std::vector<std::string>& words, int threads_num = 0);
+    StreamRecognizer Stream() const { return StreamRecognizer(grammar_, leo_); }  // valid while Algo is
+    void SetLeoOptimization(bool enabled) { leo_ = enabled; }  // on by default
 
 private:
 
-    const Grammar grammar_;
+    const CompiledGrammar grammar_;
+    bool leo_ = true;
+
+    template <class Stats>
+    Earley::ConfigTable StartTable(Stats& stats) const;  // closed column 0
+    // keeps first shared + 1 columns of D (built for a word with the same first shared symbols)
+    // and builds the rest for word
+    template <class Stats>
+    bool Extend(Earley::ConfigTable& D, const std::string& word, size_t shared, Stats& stats) const;
 
 };
 
-bool Algo::IsDeducible(const std::string& word) {
+CompiledGrammar::CompiledGrammar(const Grammar& grammar) {
+
+    for (const auto& rule : grammar.rules) {
+        std::vector<int> to;
+        for (char symbol : rule.to) {
+            to.push_back(GrammarRule::IsNonterminal(symbol)
+                ? AddNonterminal(std::string(1, symbol)) : AddTerminal(symbol));
+        }
+        AddRule(AddNonterminal(std::string(1, rule.from)), to);
+    }
+    SetStart(AddNonterminal(std::string(1, grammar.start_nonterminal)));
 
-    const Configuration begin_config(
-        GrammarRule(0, std::string(1, grammar_.start_nonterminal)),
-        0, 0);  // (S' -> .S, 0) config
-    const Configuration end_config(
-        GrammarRule(0, std::string(1, grammar_.start_nonterminal)),
-        1, 0);  // (S' -> S., 0) config
+}
 
-    size_t length = word.length();
-    Earley::ConfigTable D(length + 1);
-    D[0].emplace(begin_config);
+int CompiledGrammar::AddNonterminal(const std::string& name) {
 
-    for (int i = 0; i <= length; ++i) {
-        Earley::Scan(D, i - 1, word);
-        int changes_num = -1;
-        while (changes_num != 0) {
-            changes_num = Earley::Predict(D, i, grammar_);
-            changes_num += Earley::Complete(D, i);
+    auto inserted = nonterminal_ids_.emplace(name, NonterminalsNum());
+    if (inserted.second) {
+        NewNonterminal();
+    }
+    return inserted.first->second;
+
+}
+
+int CompiledGrammar::NewNonterminal() {
+    rules_by_lhs_.emplace_back();
+    nullable_.push_back(false);
+    productive_.push_back(false);
+    return NonterminalsNum() - 1;
+}
+
+int CompiledGrammar::AddRule(int from, const std::vector<int>& to) {
+
+    int rule = rule_lhs_.size();
+    rule_lhs_.push_back(from);
+    bodies_.insert(bodies_.end(), to.begin(), to.end());
+    bodies_.push_back(kEnd);
+    rule_begin_.push_back(bodies_.size());
+    rules_by_lhs_[from].push_back(rule);
+
+    Propagate(nullable_, rule, false);
+    Propagate(productive_, rule, true);
+    return rule;
+
+}
+
+bool CompiledGrammar::RuleHas(const std::vector<bool>& nonterminals, int rule, bool terminals) const {
+
+    for (int index = 0; Symbol(rule, index) != kEnd; ++index) {
+        int symbol = Symbol(rule, index);
+        if (IsNonterminal(symbol) ? !nonterminals[symbol] : !terminals) {
+            return false;
+        }
+    }
+    return true;
+
+}
+
+void CompiledGrammar::Propagate(std::vector<bool>& nonterminals, int rule, bool terminals) {
+
+    // a newly marked nonterminal can make other rules marked, so all of them are rechecked
+    // until nothing changes, it happens at most once per nonterminal
+
+    if (nonterminals[rule_lhs_[rule]] || !RuleHas(nonterminals, rule, terminals)) {
+        return;
+    }
+    nonterminals[rule_lhs_[rule]] = true;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int other = 0; other < RulesNum(); ++other) {
+            if (!nonterminals[rule_lhs_[other]] && RuleHas(nonterminals, other, terminals)) {
+                nonterminals[rule_lhs_[other]] = true;
+                changed = true;
+            }
+        }
+    }
+
+}
+
+void CompiledGrammar::SetStart(int nonterminal) {
+
+    // S' has no name, so it can't clash with nonterminals of the grammar
+    start_rule_ = AddRule(NewNonterminal(), {nonterminal});
+
+}
+
+Configuration Earley::Column::const_iterator::operator*() const {
+    return table_->At(position_);
+}
+
+Earley::Column::const_iterator Earley::Column::begin() const {
+    return const_iterator(table_, table_->Begin(j_));
+}
+
+Earley::Column::const_iterator Earley::Column::end() const {
+    return const_iterator(table_, table_->End(j_));
+}
+
+size_t Earley::Column::size() const {
+    return table_->End(j_) - table_->Begin(j_);
+}
+
+Configuration Earley::Column::operator[](size_t index) const {
+    return table_->At(table_->Begin(j_) + index);
+}
+
+Earley::Column::const_iterator Earley::Column::find(const Configuration& config) const {
+
+    if (j_ == table_->open_ && !table_->slots_.empty()) {
+        size_t probes = 0;
+        int index = table_->slots_[table_->FindSlot(config, probes)];
+        return (index == -1 ? end() : const_iterator(table_, table_->Begin(j_) + index));
+    }
+    for (size_t position = table_->Begin(j_); position < table_->End(j_); ++position) {
+        if (table_->At(position) == config) {
+            return const_iterator(table_, position);
+        }
+    }
+    return end();
+
+}
+
+size_t Earley::Column::Bytes() const {
+    return table_->ColumnBytes(j_);
+}
+
+template <class Stats>
+bool Earley::ConfigTable::emplace(int j, int rule, int index, int symbols_read, Stats& stats) {
+
+    // a closed column is final: its configurations are indexed into waiting lists, not into slots_
+    assert(j >= open_ && j < columns_num_);
+    CloseColumns(j - 1);
+    const Configuration config(rule, index, symbols_read);
+    size_t size = rules_.size() - column_begin_[open_];
+    if (2 * (size + 1) > slots_.size()) {
+        Grow();
+    }
+
+    size_t probes = 0;
+    size_t slot = FindSlot(config, probes);
+    stats.AddProbes(j, probes);
+    if (slots_[slot] != -1) {
+        stats.AddDuplicate(j);
+        return false;
+    }
+    slots_[slot] = size;
+    rules_.push_back(rule);
+    indexes_.push_back(index);
+    symbols_read_.push_back(symbols_read);
+    return true;
+
+}
+
+size_t Earley::ConfigTable::FindSlot(const Configuration& config, size_t& probes) const {
+
+    // at most half of the slots are used, so probe sequences are short
+    size_t mask = slots_.size() - 1;
+    size_t slot = ConfigurationHash()(config) & mask;
+    ++probes;
+    while (slots_[slot] != -1 && At(column_begin_[open_] + slots_[slot]) != config) {
+        slot = (slot + 1) & mask;
+        ++probes;
+    }
+    return slot;
+
+}
+
+void Earley::ConfigTable::Grow() {
+
+    const size_t kMinSlots = 16;
+    slots_.assign(std::max(kMinSlots, 2 * slots_.size()), -1);
+    size_t probes = 0;
+    for (size_t position = column_begin_[open_]; position < rules_.size(); ++position) {
+        slots_[FindSlot(At(position), probes)] = position - column_begin_[open_];
+    }
+
+}
+
+void Earley::ConfigTable::CloseColumns(int j) {
+
+    // O(size log size) for a column of the given size:
+    // configurations waiting for nonterminals are sorted by the nonterminal into waiting lists
+
+    while (open_ <= j && open_ < columns_num_) {
+        closing_.clear();
+        for (size_t position = column_begin_[open_]; position < rules_.size(); ++position) {
+            int symbol = grammar_->Symbol(rules_[position], indexes_[position]);
+            if (CompiledGrammar::IsNonterminal(symbol)) {
+                closing_.emplace_back(symbol, position - column_begin_[open_]);
+            }
         }
+        std::sort(closing_.begin(), closing_.end());
+        for (size_t i = 0; i < closing_.size(); ++i) {
+            if (i == 0 || closing_[i].first != closing_[i - 1].first) {
+                lists_.push_back({closing_[i].first, waiting_.size(), Configuration(kUnknown, 0, 0)});
+            }
+            waiting_.push_back(closing_[i].second);
+        }
+        ++open_;
+        column_begin_.push_back(rules_.size());
+        lists_begin_.push_back(lists_.size());
+        slots_.clear();
+    }
+
+}
+
+void Earley::ConfigTable::Truncate(int columns_num) {
+
+    rules_.resize(column_begin_[columns_num]);
+    indexes_.resize(column_begin_[columns_num]);
+    symbols_read_.resize(column_begin_[columns_num]);
+    waiting_.resize(WaitingBegin(columns_num));
+    lists_.erase(lists_.begin() + lists_begin_[columns_num], lists_.end());
+    column_begin_.resize(columns_num + 1);
+    lists_begin_.resize(columns_num + 1);
+    open_ = columns_num_ = columns_num;
+    slots_.clear();
+
+}
+
+size_t Earley::ConfigTable::WaitingBegin(int j) const {
+    // lists of all columns go one after another, so it is the beginning of the first list after j
+    return lists_begin_[j] < lists_.size() ? lists_[lists_begin_[j]].begin : waiting_.size();
+}
+
+const Earley::ConfigTable::WaitingList* Earley::ConfigTable::FindList(int k, int nonterminal) const {
+
+    const WaitingList* first = lists_.data() + lists_begin_[k];
+    const WaitingList* last = lists_.data() + lists_begin_[k + 1];
+    const WaitingList* list = std::lower_bound(first, last, nonterminal,
+        [](const WaitingList& lhs, int rhs) { return lhs.nonterminal < rhs; });
+    return (list == last || list->nonterminal != nonterminal ? nullptr : list);
+
+}
+
+Earley::IndexRange Earley::ConfigTable::Waiting(int k, int nonterminal) const {
+
+    const WaitingList* list = FindList(k, nonterminal);
+    if (list == nullptr) {
+        return {nullptr, nullptr};
+    }
+    size_t end = (list + 1 == lists_.data() + lists_.size() ? waiting_.size() : (list + 1)->begin);
+    return {waiting_.data() + list->begin, waiting_.data() + end};
+
+}
+
+Configuration* Earley::ConfigTable::Transitive(int k, int nonterminal) {
+    const WaitingList* list = FindList(k, nonterminal);
+    return (list == nullptr ? nullptr : &lists_[list - lists_.data()].transitive);
+}
+
+size_t Earley::ConfigTable::ColumnBytes(int j) const {
+
+    // configurations, waiting lists with their indexes, offsets of the column
+    size_t bytes = (End(j) - Begin(j)) * 3 * sizeof(int) + 2 * sizeof(size_t);
+    if (j < open_) {
+        bytes += (lists_begin_[j + 1] - lists_begin_[j]) * sizeof(WaitingList)
+            + (WaitingBegin(j + 1) - WaitingBegin(j)) * sizeof(int);
+    }
+    return bytes;
+
+}
+
+size_t Earley::ConfigTable::Bytes() const {
+    return (rules_.capacity() + indexes_.capacity() + symbols_read_.capacity()
+            + waiting_.capacity() + slots_.capacity()) * sizeof(int)
+        + (column_begin_.capacity() + lists_begin_.capacity()) * sizeof(size_t)
+        + lists_.capacity() * sizeof(WaitingList) + closing_.capacity() * sizeof(std::pair<int, int>);
+}
+
+Earley::ConfigTable Earley::MakeTable(const CompiledGrammar& grammar, int size) {
+    return ConfigTable(grammar, size);
+}
+
+void Earley::Stats::BeginColumn(int j) {
+    Column(j);
+    column_start_ = std::chrono::steady_clock::now();
+}
+
+void Earley::Stats::EndColumn(int j) {
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - column_start_;
+    Column(j).ms += elapsed.count();
+}
+
+void Earley::Stats::AddItem(int j, ItemSource source, int rule) {
+    ++Column(j).items[static_cast<int>(source)];
+    if (rule >= static_cast<int>(items_by_rule_.size())) {
+        items_by_rule_.resize(rule + 1, 0);
+    }
+    ++items_by_rule_[rule];
+}
+
+Earley::Stats::ColumnStats& Earley::Stats::Column(int j) {
+    if (j >= static_cast<int>(columns_.size())) {
+        columns_.resize(j + 1);
+    }
+    return columns_[j];
+}
+
+void Earley::Stats::WriteJson(std::ostream& out) const {
+
+    out << "{\"columns\": [";
+    for (size_t j = 0; j < columns_.size(); ++j) {
+        const ColumnStats& column = columns_[j];
+        out << (j == 0 ? "" : ", ") << "{\"column\": " << j
+            << ", \"scan\": " << column.items[static_cast<int>(ItemSource::kScan)]
+            << ", \"predict\": " << column.items[static_cast<int>(ItemSource::kPredict)]
+            << ", \"complete\": " << column.items[static_cast<int>(ItemSource::kComplete)]
+            << ", \"rounds\": " << column.rounds << ", \"duplicates\": " << column.duplicates
+            << ", \"probes\": " << column.probes << ", \"ms\": " << column.ms << "}";
+    }
+    out << "], \"rules\": [";
+    bool first = true;
+    for (size_t rule = 0; rule < items_by_rule_.size(); ++rule) {
+        if (items_by_rule_[rule] != 0) {
+            out << (first ? "" : ", ") << "{\"rule\": " << rule << ", \"items\": " << items_by_rule_[rule] << "}";
+            first = false;
+        }
+    }
+    out << "]}";
+
+}
+
+bool Algo::IsDeducible(const std::string& word) {
+    Earley::NoStats stats;
+    return IsDeducible(word, stats);
+}
+
+template <class Stats>
+bool Algo::IsDeducible(const std::string& word, Stats& stats) {
+    Earley::ConfigTable D = StartTable(stats);
+    return Extend(D, word, 0, stats);
+}
+
+template <class Stats>
+Earley::ConfigTable Algo::StartTable(Stats& stats) const {
+
+    Earley::ConfigTable D(grammar_, 1);
+    stats.BeginColumn(0);
+    if (grammar_.IsProductiveRule(grammar_.StartRule())) {
+        D.emplace(0, grammar_.StartRule(), 0, 0, stats);  // (S' -> .S, 0) config
+        stats.AddItem(0, Earley::ItemSource::kPredict, grammar_.StartRule());
+    }
+    Earley::Close(D, 0, grammar_, leo_, nullptr, stats);
+    stats.EndColumn(0);
+    return D;
+
+}
+
+template <class Stats>
+bool Algo::Extend(Earley::ConfigTable& D, const std::string& word, size_t shared, Stats& stats) const {
+
+    // columns 0..k depend only on the first k symbols of the word, so they are kept
+
+    const Configuration end_config(grammar_.StartRule(), 1, 0);  // (S' -> S., 0) config
+
+    int length = word.length();
+    D.Truncate(shared + 1);
+
+    for (int i = shared + 1; i <= length; ++i) {
+        D.AddColumn();
+        stats.BeginColumn(i);
+        Earley::Scan(D, i - 1, word[i - 1], grammar_, nullptr, stats);
+        Earley::Close(D, i, grammar_, leo_, nullptr, stats);
+        stats.EndColumn(i);
     }
 
     return (D[length].find(end_config) != D[length].end());
 
 }
 
-void Earley::Scan(Earley::ConfigTable& D, int j, const std::string& word) {
+std::vector<bool> Algo::AreDeducible(const std::vector<std::string>& words, int threads_num) {
+
+    // Sorted words are the leaves of their trie in order: a word shares with the previous one
+    // their longest common prefix, so only columns after it are built, the trie is built once.
+    // For threads sorted words are cut into chunks where the common prefix is short,
+    // i.e. between independent subtrees of the trie, chunks are handed out to workers one by one.
+    // Every chunk starts from a copy of the closed column 0.
+
+    std::vector<size_t> order(words.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&words](size_t lhs, size_t rhs) {
+        return words[lhs] < words[rhs];
+    });
+
+    std::vector<size_t> common_prefix(order.size(), 0);  // with the previous word
+    for (size_t i = 1; i < order.size(); ++i) {
+        const std::string& lhs = words[order[i - 1]];
+        const std::string& rhs = words[order[i]];
+        size_t length = std::min(lhs.length(), rhs.length());
+        while (common_prefix[i] < length && lhs[common_prefix[i]] == rhs[common_prefix[i]]) {
+            ++common_prefix[i];
+        }
+    }
+
+    if (threads_num <= 0) {
+        threads_num = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t chunks_per_thread = 4;
+    size_t chunks_num = std::min(order.size(), threads_num == 1 ? 1 : threads_num * chunks_per_thread);
+    std::vector<size_t> cuts = {0};
+    for (size_t chunk = 1; chunk < chunks_num; ++chunk) {
+        // the shortest common prefix near the even cut
+        size_t even_cut = chunk * order.size() / chunks_num;
+        size_t window = order.size() / chunks_num / 4;
+        size_t cut = even_cut;
+        for (size_t i = std::max(cuts.back() + 1, even_cut - std::min(even_cut, window));
+             i < std::min(order.size(), even_cut + window + 1); ++i) {
+            if (common_prefix[i] < common_prefix[cut]) {
+                cut = i;
+            }
+        }
+        if (cut > cuts.back()) {
+            cuts.push_back(cut);
+        }
+    }
+    cuts.push_back(order.size());
+
+    Earley::NoStats stats;
+    const Earley::ConfigTable start_table = StartTable(stats);
+    std::vector<char> answers(words.size());  // not vector<bool>: workers write to it concurrently
+    std::atomic<size_t> next_chunk(0);
+    auto work = [&] {
+        Earley::NoStats stats;
+        for (size_t chunk = next_chunk++; chunk + 1 < cuts.size(); chunk = next_chunk++) {
+            Earley::ConfigTable D = start_table;
+            for (size_t i = cuts[chunk]; i < cuts[chunk + 1]; ++i) {
+                size_t shared = (i == cuts[chunk] ? 0 : common_prefix[i]);
+                answers[order[i]] = Extend(D, words[order[i]], shared, stats);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads_num && i + 1 < static_cast<int>(cuts.size()); ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    return std::vector<bool>(answers.begin(), answers.end());
+
+}
+
+Forest Algo::Parse(const std::string& word) {
 
-    if (j < 0) {
+    // O(n^3) time and memory, as the recognizer without Leo's optimization
+
+    const Configuration end_config(grammar_.StartRule(), 1, 0);  // (S' -> S., 0) config
+
+    int length = word.length();
+    Forest forest;
+    Earley::ConfigTable D = Earley::MakeTable(grammar_, length + 1);
+    if (grammar_.IsProductiveRule(grammar_.StartRule())) {
+        D.emplace(0, grammar_.StartRule(), 0, 0);
+    }
+
+    for (int i = 0; i <= length; ++i) {
+        Earley::Scan(D, i - 1, word, grammar_, &forest);
+        Earley::Close(D, i, grammar_, false, &forest);
+    }
+
+    const Forest::Node* root = nullptr;
+    if (D[length].find(end_config) != D[length].end()) {
+        root = forest.SymbolNode(grammar_.Symbol(grammar_.StartRule(), 0), 0, length);
+    }
+    forest.Finish(root);
+    return forest;
+
+}
+
+StreamRecognizer::StreamRecognizer(const CompiledGrammar& grammar, bool leo)
+    : grammar_(&grammar), leo_(leo), D_(Earley::MakeTable(grammar, 1)) {
+
+    if (grammar.IsProductiveRule(grammar.StartRule())) {
+        D_.emplace(0, grammar.StartRule(), 0, 0);  // (S' -> .S, 0) config
+    }
+    Earley::Close(D_, 0, grammar, leo);
+
+}
+
+void StreamRecognizer::Feed(char symbol) {
+
+    // O(work for one column)
+
+    ++length_;
+    if (!IsViablePrefix()) {
         return;
     }
+    int j = D_.size() - 1;
+    D_.AddColumn();
+    Earley::Scan(D_, j, symbol, *grammar_);
+    Earley::Close(D_, j + 1, *grammar_, leo_);
+
+}
+
+bool StreamRecognizer::IsAcceptedSoFar() const {
+
+    const Configuration end_config(grammar_->StartRule(), 1, 0);  // (S' -> S., 0) config
+    return (static_cast<size_t>(D_.size()) == length_ + 1 && D_.back().find(end_config) != D_.back().end());
+
+}
+
+void Earley::Scan(Earley::ConfigTable& D, int j, const std::string& word, const CompiledGrammar& grammar,
+                  Forest* forest) {
+
+    if (j >= 0) {
+        Scan(D, j, word[j], grammar, forest);
+    }
+
+}
+
+void Earley::Scan(Earley::ConfigTable& D, int j, char symbol, const CompiledGrammar& grammar, Forest* forest) {
+    NoStats stats;
+    Scan(D, j, symbol, grammar, forest, stats);
+}
+
+template <class Stats>
+void Earley::Scan(Earley::ConfigTable& D, int j, char symbol, const CompiledGrammar& grammar, Forest* forest,
+                  Stats& stats) {
 
+    int terminal = CompiledGrammar::AddTerminal(symbol);
     for (const auto& config : D[j]) {
         // if config index is before word current symbol
         // then move index and add new config
-        if (config.index < config.rule.to.length()
-            && !GrammarRule::IsNonterminal(config.rule.to[config.index])
-            && config.rule.to[config.index] == word[j]) {
+        if (grammar.Symbol(config.rule, config.index) == terminal) {
+            if (D.emplace(j + 1, config.rule, config.index + 1, config.symbols_read, stats)) {
+                stats.AddItem(j + 1, ItemSource::kScan, config.rule);
+            }
+            if (forest != nullptr) {
+                forest->AddAlternative(
+                    forest->ItemNode(config.rule, config.index + 1, config.symbols_read, j + 1), j,
+                    config.index == 0 ? nullptr : forest->ItemNode(config.rule, config.index, config.symbols_read, j),
+                    forest->SymbolNode(terminal, j, j + 1));
+            }
+        }
+    }
+
+}
+
+int Earley::Close(Earley::ConfigTable& D, int j, const CompiledGrammar& grammar, bool leo, Forest* forest) {
+    NoStats stats;
+    return Close(D, j, grammar, leo, forest, stats);
+}
+
+template <class Stats>
+int Earley::Close(Earley::ConfigTable& D, int j, const CompiledGrammar& grammar, bool leo, Forest* forest,
+                  Stats& stats) {
+
+    // Predict and Complete in one pass: every configuration of D[j] is taken from the agenda once.
+    // Aycock-Horspool rule: predicting a nullable nonterminal B also moves the dot over B at once.
+    // With it a completed configuration (B -> gamma., j) never has to be completed at all:
+    // every configuration of D[j] waiting for B skips B itself, whenever it appears.
+    // So only closed columns D[k], k < j, are searched for waiting configurations.
+    // With leo a completed (B -> gamma., k), k < j, adds only the top of its deterministic
+    // reduction path (see Transitive) instead of every completed configuration on it.
+    // With forest the dot moved over X from k to j is added as an alternative with pivot k,
+    // a completed configuration adds its rule as an alternative of its symbol node.
+    // D[j] is closed at the end.
+
+    D.CloseColumns(j - 1);
+    int old_size = D[j].size();
+    auto add = [&D, &stats, j](int rule, int index, int symbols_read, ItemSource source) {
+        if (D.emplace(j, rule, index, symbols_read, stats)) {
+            stats.AddItem(j, source, rule);
+        }
+    };
+    // config has moved its dot over symbol derived from word[k, j)
+    auto add_moved = [&add, &grammar, forest, j](const Configuration& config, int k) {
+        add(config.rule, config.index + 1, config.symbols_read, ItemSource::kComplete);
+        if (forest != nullptr) {
+            int symbol = grammar.Symbol(config.rule, config.index);
+            forest->AddAlternative(
+                forest->ItemNode(config.rule, config.index + 1, config.symbols_read, j), k,
+                config.index == 0 ? nullptr : forest->ItemNode(config.rule, config.index, config.symbols_read, k),
+                forest->SymbolNode(symbol, k, j));
+        }
+    };
+
+    // new configurations are added to the end of D[j], so it is the agenda itself
+    size_t round_end = 0;
+    for (size_t current = 0; current < D[j].size(); ++current) {
+        if (current == round_end) {
+            stats.AddRound(j);
+            round_end = D[j].size();
+        }
+        const Configuration config = D[j][current];
+        int symbol = grammar.Symbol(config.rule, config.index);
 
-            Configuration new_config = config;
-            ++new_config.index;
-            D[j + 1].emplace(new_config);
+        if (symbol == CompiledGrammar::kEnd) {
+            if (forest != nullptr) {
+                int length = grammar.RuleLength(config.rule);
+                forest->AddAlternative(
+                    forest->SymbolNode(grammar.RuleLhs(config.rule), config.symbols_read, j), config.rule,
+                    length == 0 ? nullptr : forest->ItemNode(config.rule, length, config.symbols_read, j), nullptr);
+            }
+            if (config.symbols_read == j) {
+                continue;
+            }
+            int lhs = grammar.RuleLhs(config.rule);
+            if (leo && forest == nullptr) {
+                Configuration top = Transitive(D, config.symbols_read, lhs, grammar);
+                if (top.rule != -1) {
+                    add(top.rule, top.index, top.symbols_read, ItemSource::kComplete);
+                    continue;
+                }
+            }
+            // (B -> gamma., k) moves the dot only in configurations of D[k] waiting for B
+            for (int index : D.Waiting(config.symbols_read, lhs)) {
+                add_moved(D[config.symbols_read][index], config.symbols_read);
+            }
+        } else if (CompiledGrammar::IsNonterminal(symbol)) {
+            // 'enter' the nonterminal: new config for all rules from it
+            for (int rule : grammar.RulesOf(symbol)) {
+                if (grammar.IsProductiveRule(rule)) {
+                    add(rule, 0, j, ItemSource::kPredict);
+                }
+            }
+            if (grammar.IsNullable(symbol)) {
+                add_moved(config, j);
+            }
+        }
+    }
+
+    int new_size = D[j].size();
+    D.CloseColumns(j);
+    return new_size - old_size;
+
+}
+
+Configuration Earley::Transitive(Earley::ConfigTable& D, int k, int nonterminal, const CompiledGrammar& grammar) {
+
+    // Leo's transitive item of closed column D[k] for nonterminal B (rule -1 if there is none).
+    // If (A -> alpha.B, i) is the only configuration of D[k] waiting for B, completing B
+    // deterministically completes (A -> alphaB., i), which then completes A in D[i], and so on.
+    // The transitive item is the last completed configuration of that path,
+    // the ones in the middle are not needed for recognition.
+    // Every (column, nonterminal) is computed once, the path is walked without recursion.
+
+    std::vector<Configuration*> path;
+    Configuration top(-1, 0, 0);
 
+    while (true) {
+        Configuration* memo = D.Transitive(k, nonterminal);
+        if (memo == nullptr) {
+            break;  // nothing waits for nonterminal
         }
+        if (memo->rule != ConfigTable::kUnknown) {
+            if (memo->rule != -1) {
+                top = *memo;
+            }
+            break;
+        }
+        // marked before going on, so a path that returns to (k, B) through unit rules stops here
+        *memo = Configuration(-1, 0, 0);
+        IndexRange waiting = D.Waiting(k, nonterminal);
+        const Configuration penultimate = D[k][*waiting.begin()];
+        if (waiting.size() != 1 || grammar.Symbol(penultimate.rule, penultimate.index + 1) != CompiledGrammar::kEnd) {
+            break;
+        }
+        path.push_back(memo);
+        top = Configuration(penultimate.rule, penultimate.index + 1, penultimate.symbols_read);
+        k = top.symbols_read;
+        nonterminal = grammar.RuleLhs(top.rule);
     }
 
+    for (Configuration* memo : path) {
+        *memo = top;
+    }
+    return top;
+
 }
 
-int Earley::Predict(Earley::ConfigTable& D, int j, const Grammar& grammar) {
+template <class T, class... Args>
+T* Arena::New(Args&&... args) {
 
-    std::unordered_set<Configuration, ConfigurationHash> new_configurations;
+    static_assert(std::is_trivially_destructible<T>::value, "arena never calls destructors");
+    static_assert(sizeof(T) <= kBlockSize, "object doesn't fit in a block");
 
-    for (const auto& config : D[j]) {
-        if (config.index < config.rule.to.length()
-        && GrammarRule::IsNonterminal(config.rule.to[config.index])) {
-            // if config index is before nonterminal
-            // then 'enter' it and add new config for all rules from it
-            for (const auto& rule : grammar.rules) {
-                if (rule.from == config.rule.to[config.index]
-                && D[j].find(Configuration(rule, 0, j)) == D[j].end()) {
-                    new_configurations.emplace(rule, 0, j);
+    size_t offset = (used_ + alignof(T) - 1) / alignof(T) * alignof(T);
+    if (offset + sizeof(T) > kBlockSize) {
+        blocks_.emplace_back(new char[kBlockSize]);
+        offset = 0;
+    }
+    used_ = offset + sizeof(T);
+    return new (blocks_.back().get() + offset) T{std::forward<Args>(args)...};
+
+}
+
+size_t Forest::NodeKeyHash::operator()(const NodeKey& key) const {
+    uint64_t hash = uint64_t(uint32_t(key.symbol)) << 32 | uint32_t(key.rule);
+    for (int field : {key.index, key.begin, key.end}) {
+        hash = (hash ^ uint32_t(field)) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+Forest::Node* Forest::GetNode(const NodeKey& key) {
+
+    auto found = node_by_key_.find(key);
+    if (found != node_by_key_.end()) {
+        return found->second;
+    }
+    Node* node = arena_.New<Node>(key.symbol, key.rule, key.index, key.begin, key.end, nullptr,
+                                  static_cast<int>(nodes_.size()), 0, Count(0));
+    node_by_key_.emplace(key, node);
+    nodes_.push_back(node);
+    return node;
+
+}
+
+Forest::Node* Forest::SymbolNode(int symbol, int begin, int end) {
+    return GetNode({symbol, -1, 0, begin, end});
+}
+
+Forest::Node* Forest::ItemNode(int rule, int index, int begin, int end) {
+    return GetNode({0, rule, index, begin, end});
+}
+
+void Forest::AddAlternative(Node* node, int pivot, const Node* left, const Node* right) {
+
+    // the same alternative is found once for every completed rule of the right symbol, it is kept once
+    uint64_t key = uint64_t(node->number) << 32 | uint32_t(pivot);
+    if (alternative_keys_.insert(key).second) {
+        node->alternatives = arena_.New<Packed>(pivot, left, right, node->alternatives);
+        ++packed_num_;
+    }
+
+}
+
+void Forest::Finish(const Node* root) {
+
+    // O(V log V + E)
+
+    root_ = root;
+    CountHeights();
+    CountDerivations();
+    // only nodes are needed from now on
+    node_by_key_.clear();
+    alternative_keys_.clear();
+
+}
+
+void Forest::CountHeights() {
+
+    // Knuth's generalization of Dijkstra's algorithm: height of a node is 1 + the lowest
+    // max height of children among its alternatives, terminal nodes have height 0.
+    // The lowest alternative of every node is moved to the front of its list:
+    // following first alternatives always goes down in height, so even in cyclic forests
+    // unranking a derivation terminates.
+
+    // heights are INT_MAX until they are final, an alternative is ready when all its children are final
+    std::vector<std::vector<std::pair<Node*, const Packed*>>> users(nodes_.size());
+    std::priority_queue<std::pair<int, Node*>, std::vector<std::pair<int, Node*>>,
+                        std::greater<std::pair<int, Node*>>> queue;
+    auto children_height = [](const Packed* packed) {
+        int height = 0;
+        for (const Node* child : {packed->left, packed->right}) {
+            if (child != nullptr) {
+                height = std::max(height, child->height);
+            }
+        }
+        return height;
+    };
+
+    for (Node* node : nodes_) {
+        node->height = INT_MAX;
+        if (node->alternatives == nullptr) {
+            queue.emplace(0, node);
+        }
+        for (const Packed* packed = node->alternatives; packed != nullptr; packed = packed->next) {
+            if (packed->left == nullptr && packed->right == nullptr) {
+                queue.emplace(1, node);
+            }
+            for (const Node* child : {packed->left, packed->right}) {
+                if (child != nullptr) {
+                    users[child->number].emplace_back(node, packed);
                 }
             }
+        }
+    }
 
+    while (!queue.empty()) {
+        int height = queue.top().first;
+        Node* node = queue.top().second;
+        queue.pop();
+        if (node->height != INT_MAX) {
+            continue;
+        }
+        node->height = height;
+        for (const auto& user : users[node->number]) {
+            int ready_height = children_height(user.second);
+            if (ready_height != INT_MAX && user.first->height == INT_MAX) {
+                queue.emplace(ready_height + 1, user.first);
+            }
         }
     }
 
-    int old_size = D[j].size();
-    D[j].merge(new_configurations);
-    int new_size = D[j].size();
-    return new_size - old_size;
+    for (Node* node : nodes_) {
+        Packed* lowest = nullptr;
+        Packed* lowest_previous = nullptr;
+        int lowest_height = INT_MAX;
+        for (Packed *packed = node->alternatives, *previous = nullptr; packed != nullptr;
+             previous = packed, packed = packed->next) {
+            if (children_height(packed) < lowest_height) {
+                lowest = packed;
+                lowest_previous = previous;
+                lowest_height = children_height(packed);
+            }
+        }
+        if (lowest_previous != nullptr) {
+            lowest_previous->next = lowest->next;
+            lowest->next = node->alternatives;
+            node->alternatives = lowest;
+        }
+    }
 
 }
 
-int Earley::Complete(Earley::ConfigTable& D, int j) {
+void Forest::CountDerivations() {
+
+    // Saturating sums of products of children counts in DFS post-order (without recursion).
+    // A node that reaches a cycle has infinitely many derivations:
+    // every node of the forest derives its span, so the cycle can be repeated any number of times.
 
-    std::unordered_set<Configuration, ConfigurationHash> new_configurations;
+    auto multiply = [](Count lhs, Count rhs) {
+        Count product;
+        return __builtin_mul_overflow(lhs, rhs, &product) ? kInfinity : product;
+    };
+    auto add = [](Count lhs, Count rhs) {
+        Count sum;
+        return __builtin_add_overflow(lhs, rhs, &sum) ? kInfinity : sum;
+    };
+    auto packed_count = [&multiply](const Packed* packed) {
+        Count count = 1;
+        for (const Node* child : {packed->left, packed->right}) {
+            if (child != nullptr) {
+                count = multiply(count, child->derivations_num);
+            }
+        }
+        return count;
+    };
 
-    for (int k = 0; k <= j; ++k) {
-        for (const auto& config_k : D[k]) {
-            for (const auto& config_j : D[j]) {
+    enum State { kNew, kOnStack, kDone };
+    std::vector<State> states(nodes_.size(), kNew);
 
-                Configuration new_config = config_k;
-                ++new_config.index;
+    struct Frame {
+        Node* node;
+        const Packed* packed;
+        int child;  // 0 is left, 1 is right
+    };
+    std::vector<Frame> stack;
 
-                // if config index is in the end of the rule
-                // then find rule from which we 'entered' current rule and move index there
-                if (D[j].find(new_config) == D[j].end()
-                    && config_j != config_k && config_j.symbols_read == k
-                    && config_k.index < config_k.rule.to.length() && config_j.index == config_j.rule.to.length()
-                    && GrammarRule::IsNonterminal(config_k.rule.to[config_k.index])
-                    && config_j.rule.from == config_k.rule.to[config_k.index]) {
-                    new_configurations.emplace(new_config);
+    for (Node* start : nodes_) {
+        if (states[start->number] != kNew) {
+            continue;
+        }
+        states[start->number] = kOnStack;
+        start->derivations_num = 0;
+        stack.push_back({start, start->alternatives, 0});
+        while (!stack.empty()) {
+            Frame& frame = stack.back();
+            if (frame.packed == nullptr) {
+                Node* node = frame.node;
+                if (node->alternatives == nullptr) {
+                    node->derivations_num = 1;  // terminal
+                } else if (node->derivations_num != kInfinity) {
+                    for (const Packed* packed = node->alternatives; packed != nullptr; packed = packed->next) {
+                        node->derivations_num = add(node->derivations_num, packed_count(packed));
+                    }
                 }
+                states[node->number] = kDone;
+                stack.pop_back();
+                continue;
+            }
+            if (frame.child == 2) {
+                frame.packed = frame.packed->next;
+                frame.child = 0;
+                continue;
+            }
+            const Node* child = (frame.child++ == 0 ? frame.packed->left : frame.packed->right);
+            if (child == nullptr) {
+                continue;
+            }
+            if (states[child->number] == kOnStack) {
+                frame.node->derivations_num = kInfinity;
+            } else if (states[child->number] == kNew) {
+                Node* next = const_cast<Node*>(child);
+                states[next->number] = kOnStack;
+                next->derivations_num = 0;
+                stack.push_back({next, next->alternatives, 0});
+            }
+        }
+    }
+
+}
+
+std::vector<int> Forest::Derivation(Count k) const {
+
+    // O(size of the derivation)
+    // Unranking: in every node the alternative is chosen by k and counts of the alternatives before it,
+    // then k is split between the children of the alternative.
+
+    std::vector<int> rules;
+    if (root_ == nullptr) {
+        return rules;
+    }
 
+    std::vector<std::pair<const Node*, Count>> stack = {{root_, k}};
+    while (!stack.empty()) {
+        const Node* node = stack.back().first;
+        Count index = stack.back().second;
+        stack.pop_back();
+        if (node->alternatives == nullptr) {
+            continue;
+        }
+
+        const Packed* chosen = node->alternatives;
+        for (; chosen->next != nullptr; chosen = chosen->next) {
+            Count count = 1;
+            for (const Node* child : {chosen->left, chosen->right}) {
+                if (child != nullptr) {
+                    Count product;
+                    count = __builtin_mul_overflow(count, child->derivations_num, &product) ? kInfinity : product;
+                }
             }
+            if (index < count) {
+                break;
+            }
+            index -= count;
+        }
+
+        if (node->rule == -1) {
+            rules.push_back(chosen->pivot);
+        }
+        // the right child is handled after the left one, so it is pushed first
+        Count right_num = (chosen->right == nullptr ? 1 : chosen->right->derivations_num);
+        Count left_index = (right_num == kInfinity ? 0 : index / right_num);
+        Count right_index = (right_num == kInfinity ? index : index % right_num);
+        if (chosen->right != nullptr) {
+            stack.emplace_back(chosen->right, right_index);
+        }
+        if (chosen->left != nullptr) {
+            stack.emplace_back(chosen->left, left_index);
         }
     }
 
-    int old_size = D[j].size();
-    D[j].merge(new_configurations);
-    int new_size = D[j].size();
-    return new_size - old_size;
+    return rules;
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Algo.cpp"
+
+class CYK {
+    // Cocke-Younger-Kasami recognizer, the grammar is converted to Chomsky normal form:
+    // every rule is A -> BC or A -> a, S -> eps is kept as a flag.
+    // Two modes answer the same question:
+    // kSpans fills the table span by span, every span keeps a bitset of its nonterminals, O(n^3 * |G|);
+    // kValiant is the divide and conquer of Valiant (in Okhotin's formulation), all the work
+    // is boolean matrix products, one per pair (B, C) of right sides, done by 64-bit rows
+    // and spread over threads.
+public:
+
+    enum class Mode { kSpans, kValiant };
+
+    explicit CYK(const Grammar& grammar) : CYK(CompiledGrammar(grammar)) {}
+    explicit CYK(const CompiledGrammar& grammar);
+
+    bool IsDeducible(const std::string& word) const;  // check if word can be determined by grammar
+    void SetMode(Mode mode) { mode_ = mode; }  // kSpans by default
+    // threads of kValiant products, threads_num = 0 means one thread per core
+    void SetThreadsNum(int threads_num) { threads_num_ = threads_num; }
+    int NonterminalsNum() const { return nonterminals_num_; }  // after the conversion
+    int BinaryRulesNum() const { return binary_rules_num_; }
+
+private:
+
+    typedef uint64_t Word;
+    static const int kWordBits = 64;
+
+    class BitMatrix {
+        // boolean (size x size) matrix, rows are 64-bit words
+    public:
+        BitMatrix() = default;
+        explicit BitMatrix(int size) : row_words_((size + kWordBits - 1) / kWordBits), bits_(size * row_words_, 0) {}
+        bool Get(int row, int column) const { return (Row(row)[column / kWordBits] >> (column % kWordBits)) & 1u; }
+        void Set(int row, int column) { Row(row)[column / kWordBits] |= Word(1) << (column % kWordBits); }
+        Word* Row(int index) { return bits_.data() + index * row_words_; }
+        const Word* Row(int index) const { return bits_.data() + index * row_words_; }
+    private:
+        int row_words_ = 0;
+        std::vector<Word> bits_;
+    };
+
+    struct ValiantState {
+        // table of one word: T[A](i, j) iff A =>* word[i, j), P[p](i, j) iff B(i, k) and C(k, j)
+        // for pair p = (B, C) and some k checked so far
+        std::vector<BitMatrix> table;  // by nonterminal
+        std::vector<BitMatrix> products;  // by pair
+        int threads_num;
+    };
+
+    int nonterminals_num_ = 0;
+    int binary_rules_num_ = 0;
+    int start_ = -1;
+    bool accepts_empty_ = false;
+    std::vector<std::vector<int>> terminal_rules_;  // by terminal char: all A with A -> a
+    std::vector<std::vector<std::pair<int, int>>> rules_by_first_;  // by B: all (C, A) with A -> BC
+    std::vector<std::pair<int, int>> pairs_;  // different right sides (B, C)
+    std::vector<std::vector<int>> pair_lhs_;  // by pair: all A with A -> BC
+    Mode mode_ = Mode::kSpans;
+    int threads_num_ = 1;
+
+    bool SpansDeducible(const std::string& word) const;
+    bool ValiantDeducible(const std::string& word) const;
+    // T(i, j) for i < j of positions [begin, end)
+    void Compute(ValiantState& state, int begin, int end) const;
+    // T of the block rows [row_begin, row_end) x columns [column_begin, column_end), row_end <= column_begin,
+    // P of it must have every k in [row_end, column_begin), T of both triangles must be ready
+    void Complete(ValiantState& state, int row_begin, int row_end, int column_begin, int column_end) const;
+    // P(rows, columns) |= T(rows, inner) x T(inner, columns) for every pair
+    void Multiply(ValiantState& state, int row_begin, int row_end, int inner_begin, int inner_end,
+                  int column_begin, int column_end) const;
+
+};
+
+CYK::CYK(const CompiledGrammar& grammar) {
+
+    // O(|G|^2)
+    // START: S' of the compiled grammar is dropped, the start is a flag for eps and a nonterminal;
+    // TERM, BIN: terminals of long bodies get their own nonterminals, bodies are cut into pairs;
+    // DEL: eps rules are dropped, every rule gets its variants without nullable symbols;
+    // UNIT: A gets all non-unit rules of every B with A =>* B by unit rules.
+
+    start_ = grammar.Symbol(grammar.StartRule(), 0);
+    accepts_empty_ = grammar.IsNullable(start_);
+    nonterminals_num_ = grammar.NonterminalsNum();
+
+    std::vector<int> lhs;
+    std::vector<std::vector<int>> bodies;
+    std::vector<int> terminal_nonterminal(UCHAR_MAX + 1, -1);
+    for (int rule = 0; rule < grammar.RulesNum(); ++rule) {
+        if (rule == grammar.StartRule() || !grammar.IsProductiveRule(rule)) {
+            continue;
+        }
+        std::vector<int> body;
+        for (int index = 0; index < grammar.RuleLength(rule); ++index) {
+            body.push_back(grammar.Symbol(rule, index));
+        }
+        if (body.size() >= 2) {
+            for (int& symbol : body) {
+                if (!CompiledGrammar::IsNonterminal(symbol)) {
+                    int& nonterminal = terminal_nonterminal[-1 - symbol];
+                    if (nonterminal == -1) {
+                        nonterminal = nonterminals_num_++;
+                        lhs.push_back(nonterminal);
+                        bodies.push_back({symbol});
+                    }
+                    symbol = nonterminal;
+                }
+            }
+        }
+        int from = grammar.RuleLhs(rule);
+        while (body.size() > 2) {
+            int rest = nonterminals_num_++;
+            lhs.push_back(from);
+            bodies.push_back({body[0], rest});
+            body.erase(body.begin());
+            from = rest;
+        }
+        lhs.push_back(from);
+        bodies.push_back(body);
+    }
+
+    std::vector<bool> nullable(nonterminals_num_, false);
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t rule = 0; rule < bodies.size(); ++rule) {
+            bool all_nullable = true;
+            for (int symbol : bodies[rule]) {
+                all_nullable = all_nullable && CompiledGrammar::IsNonterminal(symbol) && nullable[symbol];
+            }
+            if (all_nullable && !nullable[lhs[rule]]) {
+                nullable[lhs[rule]] = true;
+                changed = true;
+            }
+        }
+    }
+
+    // rules without eps: binary by B, terminal, unit
+    std::vector<std::set<std::pair<int, int>>> binary(nonterminals_num_);  // by A: all (B, C)
+    std::vector<std::set<int>> terminal(nonterminals_num_);  // by A: all terminals a
+    std::vector<std::vector<int>> unit(nonterminals_num_);  // by A: all B
+    auto add_short = [&](int from, int symbol) {
+        if (CompiledGrammar::IsNonterminal(symbol)) {
+            unit[from].push_back(symbol);
+        } else {
+            terminal[from].insert(symbol);
+        }
+    };
+    for (size_t rule = 0; rule < bodies.size(); ++rule) {
+        const std::vector<int>& body = bodies[rule];
+        if (body.size() == 1) {
+            add_short(lhs[rule], body[0]);
+        } else if (body.size() == 2) {
+            binary[lhs[rule]].emplace(body[0], body[1]);
+            if (nullable[body[1]]) {
+                add_short(lhs[rule], body[0]);
+            }
+            if (nullable[body[0]]) {
+                add_short(lhs[rule], body[1]);
+            }
+        }
+    }
+
+    terminal_rules_.assign(UCHAR_MAX + 1, std::vector<int>());
+    rules_by_first_.assign(nonterminals_num_, std::vector<std::pair<int, int>>());
+    std::vector<std::set<std::pair<int, int>>> final_binary(nonterminals_num_);
+    std::vector<bool> reached(nonterminals_num_);
+    for (int from = 0; from < nonterminals_num_; ++from) {
+        // all B with from =>* B by unit rules
+        std::fill(reached.begin(), reached.end(), false);
+        std::vector<int> stack = {from};
+        reached[from] = true;
+        std::set<int> terminals;
+        while (!stack.empty()) {
+            int current = stack.back();
+            stack.pop_back();
+            final_binary[from].insert(binary[current].begin(), binary[current].end());
+            terminals.insert(terminal[current].begin(), terminal[current].end());
+            for (int next : unit[current]) {
+                if (!reached[next]) {
+                    reached[next] = true;
+                    stack.push_back(next);
+                }
+            }
+        }
+        for (int symbol : terminals) {
+            terminal_rules_[-1 - symbol].push_back(from);
+        }
+    }
+
+    std::set<std::pair<int, int>> all_pairs;
+    for (int from = 0; from < nonterminals_num_; ++from) {
+        for (const auto& pair : final_binary[from]) {
+            rules_by_first_[pair.first].emplace_back(pair.second, from);
+            all_pairs.insert(pair);
+        }
+        binary_rules_num_ += final_binary[from].size();
+    }
+    pairs_.assign(all_pairs.begin(), all_pairs.end());
+    pair_lhs_.assign(pairs_.size(), std::vector<int>());
+    for (int from = 0; from < nonterminals_num_; ++from) {
+        for (const auto& pair : final_binary[from]) {
+            int index = std::lower_bound(pairs_.begin(), pairs_.end(), pair) - pairs_.begin();
+            pair_lhs_[index].push_back(from);
+        }
+    }
+
+}
+
+bool CYK::IsDeducible(const std::string& word) const {
+    if (word.empty()) {
+        return accepts_empty_;
+    }
+    return mode_ == Mode::kSpans ? SpansDeducible(word) : ValiantDeducible(word);
+}
+
+bool CYK::SpansDeducible(const std::string& word) const {
+
+    // O(n^3 * |G|)
+    // span (i, i + length) has its bitset at offset (length - 1) * (n + 1) + i
+
+    int length = word.length();
+    int set_words = (nonterminals_num_ + kWordBits - 1) / kWordBits;
+    std::vector<Word> spans(static_cast<size_t>(length) * (length + 1) * set_words, 0);
+    auto span = [&](int begin, int span_length) {
+        return spans.data() + (static_cast<size_t>(span_length - 1) * (length + 1) + begin) * set_words;
+    };
+
+    for (int i = 0; i < length; ++i) {
+        for (int nonterminal : terminal_rules_[static_cast<unsigned char>(word[i])]) {
+            span(i, 1)[nonterminal / kWordBits] |= Word(1) << (nonterminal % kWordBits);
+        }
+    }
+
+    for (int span_length = 2; span_length <= length; ++span_length) {
+        for (int begin = 0; begin + span_length <= length; ++begin) {
+            Word* current = span(begin, span_length);
+            for (int split = 1; split < span_length; ++split) {
+                const Word* left = span(begin, split);
+                const Word* right = span(begin + split, span_length - split);
+                for (int word_index = 0; word_index < set_words; ++word_index) {
+                    Word bits = left[word_index];
+                    while (bits != 0) {
+                        int first = word_index * kWordBits + __builtin_ctzll(bits);
+                        bits &= bits - 1;
+                        for (const auto& rule : rules_by_first_[first]) {
+                            if ((right[rule.first / kWordBits] >> (rule.first % kWordBits)) & 1u) {
+                                current[rule.second / kWordBits] |= Word(1) << (rule.second % kWordBits);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return (span(0, length)[start_ / kWordBits] >> (start_ % kWordBits)) & 1u;
+
+}
+
+bool CYK::ValiantDeducible(const std::string& word) const {
+
+    // O(|pairs| * BMM(n) * log n), BMM(n) = n^3 / 64 for products done by rows
+
+    int size = word.length() + 1;  // positions 0, 1, ..., n
+    ValiantState state;
+    state.threads_num = (threads_num_ == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads_num_);
+    state.threads_num = std::min<int>(state.threads_num, pairs_.size());
+    state.table.assign(nonterminals_num_, BitMatrix(size));
+    state.products.assign(pairs_.size(), BitMatrix(size));
+
+    for (int i = 0; i + 1 < size; ++i) {
+        for (int nonterminal : terminal_rules_[static_cast<unsigned char>(word[i])]) {
+            state.table[nonterminal].Set(i, i + 1);
+        }
+    }
+    Compute(state, 0, size);
+
+    return state.table[start_].Get(0, size - 1);
+
+}
+
+void CYK::Compute(ValiantState& state, int begin, int end) const {
+
+    // spans inside each half are independent of the other half,
+    // the block between the halves needs both of them
+
+    if (end - begin <= 2) {
+        return;  // only (begin, begin + 1), it is set by the word
+    }
+    int middle = (begin + end) / 2;
+    Compute(state, begin, middle);
+    Compute(state, middle, end);
+    Complete(state, begin, middle, middle, end);
+
+}
+
+void CYK::Complete(ValiantState& state, int row_begin, int row_end, int column_begin, int column_end) const {
+
+    // (i, j) of the block still misses every k in (i, row_end) and [column_begin, j).
+    // The block is cut into quarters: bottom left (nearest to the diagonal) misses nothing new,
+    // others get the products with the parts completed before them.
+
+    int rows = row_end - row_begin;
+    int columns = column_end - column_begin;
+    if (rows == 1 && columns == 1) {
+        if (column_begin - row_begin >= 2) {
+            for (size_t pair = 0; pair < pairs_.size(); ++pair) {
+                if (state.products[pair].Get(row_begin, column_begin)) {
+                    for (int nonterminal : pair_lhs_[pair]) {
+                        state.table[nonterminal].Set(row_begin, column_begin);
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    int row_middle = (rows > 1 ? (row_begin + row_end) / 2 : row_begin);
+    int column_middle = (columns > 1 ? (column_begin + column_end) / 2 : column_end);
+    if (rows > 1 && columns > 1) {
+        Complete(state, row_middle, row_end, column_begin, column_middle);
+        Multiply(state, row_begin, row_middle, row_middle, row_end, column_begin, column_middle);
+        Complete(state, row_begin, row_middle, column_begin, column_middle);
+        Multiply(state, row_middle, row_end, column_begin, column_middle, column_middle, column_end);
+        Complete(state, row_middle, row_end, column_middle, column_end);
+        Multiply(state, row_begin, row_middle, row_middle, row_end, column_middle, column_end);
+        Multiply(state, row_begin, row_middle, column_begin, column_middle, column_middle, column_end);
+        Complete(state, row_begin, row_middle, column_middle, column_end);
+    } else if (rows > 1) {
+        Complete(state, row_middle, row_end, column_begin, column_end);
+        Multiply(state, row_begin, row_middle, row_middle, row_end, column_begin, column_end);
+        Complete(state, row_begin, row_middle, column_begin, column_end);
+    } else {
+        Complete(state, row_begin, row_end, column_begin, column_middle);
+        Multiply(state, row_begin, row_end, column_begin, column_middle, column_middle, column_end);
+        Complete(state, row_begin, row_end, column_middle, column_end);
+    }
+
+}
+
+void CYK::Multiply(ValiantState& state, int row_begin, int row_end, int inner_begin, int inner_end,
+                   int column_begin, int column_end) const {
+
+    // O(|pairs| * rows * inner * columns / 64)
+    // Row i of P is OR of rows k of T[C] for every bit k set in row i of T[B].
+    // Whole words are OR-ed, bits outside the columns are true products too (T is only set
+    // when it is final), so they never break anything.
+
+    int first_word = column_begin / kWordBits;
+    int last_word = (column_end - 1) / kWordBits;
+    auto multiply_pairs = [&](size_t pair_begin, size_t pair_end) {
+        for (size_t pair = pair_begin; pair < pair_end; ++pair) {
+            const BitMatrix& lhs = state.table[pairs_[pair].first];
+            const BitMatrix& rhs = state.table[pairs_[pair].second];
+            BitMatrix& result = state.products[pair];
+            for (int i = row_begin; i < row_end; ++i) {
+                const Word* lhs_row = lhs.Row(i);
+                Word* result_row = result.Row(i);
+                for (int word = inner_begin / kWordBits; word * kWordBits < inner_end; ++word) {
+                    Word bits = lhs_row[word];
+                    if (word * kWordBits < inner_begin) {
+                        bits &= ~Word(0) << (inner_begin % kWordBits);
+                    }
+                    if ((word + 1) * kWordBits > inner_end) {
+                        bits &= ~(~Word(0) << (inner_end % kWordBits));
+                    }
+                    while (bits != 0) {
+                        int k = word * kWordBits + __builtin_ctzll(bits);
+                        bits &= bits - 1;
+                        const Word* rhs_row = rhs.Row(k);
+                        for (int column = first_word; column <= last_word; ++column) {
+                            result_row[column] |= rhs_row[column];
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    // threads only pay off for big blocks
+    const long long kMinParallelWork = 1 << 14;
+    if (state.threads_num <= 1 || static_cast<long long>(row_end - row_begin) * (inner_end - inner_begin) < kMinParallelWork) {
+        multiply_pairs(0, pairs_.size());
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (int thread = 0; thread < state.threads_num; ++thread) {
+        workers.emplace_back(multiply_pairs, pairs_.size() * thread / state.threads_num,
+                             pairs_.size() * (thread + 1) / state.threads_num);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+}
@@ -0,0 +1,293 @@
+#include <chrono>
+#include <random>
+#include "Algo.cpp"
+#include "CYK.cpp"
+
+template <class Parser>
+double MeasureMs(Parser& parser, const std::string& word, bool expected) {
+
+    auto begin = std::chrono::steady_clock::now();
+    bool deducible = parser.IsDeducible(word);
+    auto end = std::chrono::steady_clock::now();
+    if (deducible != expected) {
+        std::cout << "wrong answer for word of length " << word.length() << "\n";
+    }
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+
+}
+
+void BenchRightRecursion(const std::string& name, const Grammar& grammar,
+                         const std::string& unit, const std::string& tail) {
+
+    // words unit^k tail, without Leo's optimization chart grows as O(n^2)
+    const int classic_max_units = 4000;
+
+    Algo leo_parser(grammar);
+    Algo classic_parser(grammar);
+    classic_parser.SetLeoOptimization(false);
+
+    std::cout << name << "\n";
+    std::cout << "length\tleo, ms\tclassic, ms\n";
+    for (int units_num = 500; units_num <= 64000; units_num *= 2) {
+        std::string word;
+        for (int i = 0; i < units_num; ++i) {
+            word += unit;
+        }
+        word += tail;
+        std::cout << word.length() << "\t" << MeasureMs(leo_parser, word, true) << "\t";
+        if (units_num <= classic_max_units) {
+            std::cout << MeasureMs(classic_parser, word, true);
+        } else {
+            std::cout << "-";
+        }
+        std::cout << "\n";
+    }
+    std::cout << "\n";
+
+}
+
+void BenchBatch() {
+
+    // { w: 2 * |w|(a) - |w|(b) = -2 } from tests, words are long common prefixes with short tails
+    std::vector<GrammarRule> G_rules = {
+        GrammarRule('S', "TbTbT"),
+        GrammarRule('T', "aTbTbT"),
+        GrammarRule('T', "bTbTaT"),
+        GrammarRule('T', "bTaTbT"),
+        GrammarRule('T', "")
+    };
+    Algo parser(Grammar(G_rules, 'S'));
+
+    std::mt19937 generator(2020);
+    auto random_word = [&generator](int length) {
+        std::string word;
+        for (int i = 0; i < length; ++i) {
+            word.push_back("abb"[generator() % 3]);
+        }
+        return word;
+    };
+    std::vector<std::string> prefixes;
+    for (int i = 0; i < 20; ++i) {
+        prefixes.push_back(random_word(300));
+    }
+    std::vector<std::string> words;
+    for (int i = 0; i < 1000; ++i) {
+        words.push_back(prefixes[generator() % prefixes.size()] + random_word(generator() % 10));
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<bool> expected;
+    for (const auto& word : words) {
+        expected.push_back(parser.IsDeducible(word));
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "batch of " << words.size() << " words\n";
+    std::cout << "one by one, ms\t" << std::chrono::duration<double, std::milli>(end - begin).count() << "\n";
+
+    for (int threads_num : {1, 0}) {
+        begin = std::chrono::steady_clock::now();
+        bool same = (parser.AreDeducible(words, threads_num) == expected);
+        end = std::chrono::steady_clock::now();
+        std::cout << "AreDeducible, " << (threads_num == 0 ? "all threads" : "1 thread") << ", ms\t"
+            << std::chrono::duration<double, std::milli>(end - begin).count() << (same ? "" : "\twrong answers") << "\n";
+    }
+    std::cout << "\n";
+
+}
+
+void BenchCYK() {
+
+    // { w: 2 * |w|(a) - |w|(b) = -2 } from tests, words (abbabb)^k bb,
+    // both Earley and CYK by spans are cubic here
+    const int cubic_max_units = 200;
+
+    Grammar G({
+        GrammarRule('S', "TbTbT"),
+        GrammarRule('T', "aTbTbT"),
+        GrammarRule('T', "bTbTaT"),
+        GrammarRule('T', "bTaTbT"),
+        GrammarRule('T', "")
+    }, 'S');
+    Algo earley_parser(G);
+    CYK spans_parser(G);
+    CYK valiant_parser(G);
+    valiant_parser.SetMode(CYK::Mode::kValiant);
+    CYK threaded_parser(G);
+    threaded_parser.SetMode(CYK::Mode::kValiant);
+    threaded_parser.SetThreadsNum(0);
+
+    std::cout << "Earley vs CYK, " << spans_parser.NonterminalsNum() << " nonterminals and "
+        << spans_parser.BinaryRulesNum() << " binary rules in CNF\n";
+    std::cout << "length\tearley, ms\tspans, ms\tvaliant, ms\tvaliant all threads, ms\n";
+    for (int units_num = 50; units_num <= 800; units_num *= 2) {
+        std::string word;
+        for (int i = 0; i < units_num; ++i) {
+            word += "abbabb";
+        }
+        word += "bb";
+        std::cout << word.length() << "\t";
+        if (units_num <= cubic_max_units) {
+            std::cout << MeasureMs(earley_parser, word, true) << "\t" << MeasureMs(spans_parser, word, true);
+        } else {
+            std::cout << "-\t-";
+        }
+        std::cout << "\t" << MeasureMs(valiant_parser, word, true) << "\t" << MeasureMs(threaded_parser, word, true) << "\n";
+    }
+    std::cout << "\n";
+
+}
+
+struct AdditiveConfigurationHash {
+    // hash the columns used before: fields just added, (rule, 1, 2) and (rule, 2, 1) collide
+    size_t operator()(const Configuration& config) const {
+        return std::hash<int>()(config.rule) + std::hash<int>()(config.index) + std::hash<int>()(config.symbols_read);
+    }
+};
+
+template <class Hash>
+class NodeColumn {
+    // column as it was: node-based set with waiting lists of pointers to its elements
+public:
+    NodeColumn(const CompiledGrammar& grammar) : grammar_(&grammar) {}
+    bool emplace(const Configuration& config) {
+        auto result = configs_.insert(config);
+        int symbol = grammar_->Symbol(config.rule, config.index);
+        if (result.second && CompiledGrammar::IsNonterminal(symbol)) {
+            waiting_[symbol].push_back(&*result.first);
+        }
+        return result.second;
+    }
+    bool contains(const Configuration& config) const { return configs_.count(config) != 0; }
+private:
+    const CompiledGrammar* grammar_;
+    std::unordered_set<Configuration, Hash> configs_;
+    std::unordered_map<int, std::vector<const Configuration*>> waiting_;
+};
+
+double MeasureTableMs(const CompiledGrammar& grammar, const std::vector<Configuration>& configs,
+                      int columns_num, size_t& found) {
+
+    auto begin = std::chrono::steady_clock::now();
+    Earley::ConfigTable table(grammar, columns_num);
+    for (int j = 0; j < columns_num; ++j) {
+        for (const auto& config : configs) {
+            table.emplace(j, config.rule, config.index, config.symbols_read);
+        }
+        for (const auto& config : configs) {
+            found += (table[j].find(config) != table[j].end());
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+
+}
+
+template <class Hash>
+double MeasureNodeColumnMs(const CompiledGrammar& grammar, const std::vector<Configuration>& configs,
+                           int columns_num, size_t& found) {
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < columns_num; ++i) {
+        NodeColumn<Hash> column(grammar);
+        for (const auto& config : configs) {
+            column.emplace(config);
+        }
+        for (const auto& config : configs) {
+            found += column.contains(config);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+
+}
+
+void BenchColumn() {
+
+    // one column of a long word: configurations of 20 rules of length 4 with 2000 origins,
+    // every configuration is added twice, then every one is looked up;
+    // the table keeps all columns, node-based columns are freed one by one
+    const int rules_num = 20;
+    const int origins_num = 2000;
+    const int columns_num = 20;
+
+    CompiledGrammar grammar;
+    int nonterminal = grammar.AddNonterminal("S");
+    for (int rule = 0; rule < rules_num; ++rule) {
+        grammar.AddRule(nonterminal, {nonterminal, CompiledGrammar::AddTerminal('a'), nonterminal, nonterminal});
+    }
+    grammar.SetStart(nonterminal);
+
+    std::mt19937 generator(2020);
+    std::vector<Configuration> configs;
+    for (int i = 0; i < rules_num * 5 * origins_num / 4; ++i) {
+        configs.emplace_back(generator() % rules_num, generator() % 5, generator() % origins_num);
+        configs.push_back(configs.back());
+    }
+    std::shuffle(configs.begin(), configs.end(), generator);
+
+    size_t found = 0;
+    std::cout << "column of " << configs.size() << " insertions and lookups, " << columns_num << " times\n";
+    std::cout << "Earley::ConfigTable (arena, open addressing), ms\t"
+        << MeasureTableMs(grammar, configs, columns_num, found) << "\n";
+    std::cout << "unordered_set, mixing hash, ms\t"
+        << MeasureNodeColumnMs<ConfigurationHash>(grammar, configs, columns_num, found) << "\n";
+    std::cout << "unordered_set, additive hash, ms\t"
+        << MeasureNodeColumnMs<AdditiveConfigurationHash>(grammar, configs, columns_num, found) << "\n";
+    if (found != 3 * columns_num * configs.size()) {
+        std::cout << "wrong lookups\n";
+    }
+    std::cout << "\n";
+
+}
+
+void BenchChartMemory(const std::string& name, const Grammar& grammar, const std::string& unit) {
+
+    // a stream of 100000 symbols unit^k: items and bytes per column,
+    // the table is the only memory the recognizer allocates per symbol
+    const int length = 100000;
+
+    Algo parser(grammar);
+    StreamRecognizer stream = parser.Stream();
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < length; ++i) {
+        stream.Feed(unit[i % unit.length()]);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    const Earley::ConfigTable& table = stream.Table();
+    size_t items = 0;
+    size_t max_items = 0;
+    size_t max_bytes = 0;
+    for (int j = 0; j < table.size(); ++j) {
+        items += table[j].size();
+        max_items = std::max(max_items, table[j].size());
+        max_bytes = std::max(max_bytes, table[j].Bytes());
+    }
+    std::cout << name << ", stream of " << length << " symbols\n";
+    std::cout << "ms\t" << std::chrono::duration<double, std::milli>(end - begin).count() << "\n";
+    std::cout << "items\t" << items << "\n";
+    std::cout << "max items per column\t" << max_items << "\n";
+    std::cout << "max bytes per column\t" << max_bytes << "\n";
+    std::cout << "table bytes\t" << table.Bytes() << "\n\n";
+
+}
+
+int main() {
+
+    BenchRightRecursion("S -> aS | a",
+        Grammar({GrammarRule('S', "aS"), GrammarRule('S', "a")}, 'S'), "a", "a");
+    BenchRightRecursion("L -> a,L | a",
+        Grammar({GrammarRule('L', "a,L"), GrammarRule('L', "a")}, 'L'), "a,", "a");
+    // right recursion through a nullable tail
+    BenchRightRecursion("S -> aT, T -> bS | eps",
+        Grammar({GrammarRule('S', "aT"), GrammarRule('T', "bS"), GrammarRule('T', "")}, 'S'), "ab", "a");
+    BenchBatch();
+    BenchColumn();
+    BenchChartMemory("S -> aS | a", Grammar({GrammarRule('S', "aS"), GrammarRule('S', "a")}, 'S'), "a");
+    BenchChartMemory("S -> Sa | a", Grammar({GrammarRule('S', "Sa"), GrammarRule('S', "a")}, 'S'), "a");
+    BenchChartMemory("S -> aT, T -> bS | eps",
+        Grammar({GrammarRule('S', "aT"), GrammarRule('T', "bS"), GrammarRule('T', "")}, 'S'), "ab");
+    BenchCYK();
+    return 0;
+
+}
@@ -1,14 +1,17 @@
+#include <set>
+#include <sstream>
 #include "Algo.cpp"
+#include "CYK.cpp"
 
 void TestScan() {
 
-    GrammarRule BS_rule_1('S', "S(S)");
-    GrammarRule BS_rule_2('S', "(S)S");
-    Earley::ConfigTable D(2);
-    D[0].emplace(BS_rule_1, 0, 0);  // (S -> .S(S), 0)
-    D[0].emplace(BS_rule_2, 0, 0);  // (S -> .(S)S, 0)
-    Earley::Scan(D, 0, "(((((");  // adds (S -> (.S)S, 0)
-    if (D[1].size() == 1 && *(D[1].begin()) == Configuration(BS_rule_2, 1, 0)) {
+    Grammar BS({GrammarRule('S', "S(S)"), GrammarRule('S', "(S)S")}, 'S');
+    CompiledGrammar compiled(BS);
+    Earley::ConfigTable D = Earley::MakeTable(compiled, 2);
+    D.emplace(0, 0, 0, 0);  // (S -> .S(S), 0)
+    D.emplace(0, 1, 0, 0);  // (S -> .(S)S, 0)
+    Earley::Scan(D, 0, "(((((", compiled);  // adds (S -> (.S)S, 0)
+    if (D[1].size() == 1 && *(D[1].begin()) == Configuration(1, 1, 0)) {
         std::cout << "Scan test passed.\n";
     } else {
         std::cout << "Scan test failed.\n";
@@ -21,15 +24,18 @@ void TestPredict() {
     std::vector<GrammarRule> BS_rules = {
         GrammarRule('S', "T(T)"),
         GrammarRule('S', "(T)T"),
-        GrammarRule('T', "(T)")
+        GrammarRule('T', "(T)"),
+        GrammarRule('T', "()"),
+        GrammarRule('T', "(U)")  // U has no rules, so it is never predicted
     };
-    Grammar BS(BS_rules, 'S');
-    Earley::ConfigTable D(1);
-    D[0].emplace(BS_rules[0], 0, 0);  // (S -> .T(T), 0)
-    D[0].emplace(BS_rules[1], 0, 0);  // (S -> .(T)T, 0)
-    int changes_num = Earley::Predict(D, 0, BS);  // adds (T -> .(T), 0), returns 1
-    if (changes_num == 1 && D[0].size() == 3
-    && D[0].find(Configuration(BS_rules[2], 0, 0)) != D[0].end()) {
+    CompiledGrammar BS(Grammar(BS_rules, 'S'));
+    Earley::ConfigTable D = Earley::MakeTable(BS, 1);
+    D.emplace(0, 0, 0, 0);  // (S -> .T(T), 0)
+    D.emplace(0, 1, 0, 0);  // (S -> .(T)T, 0)
+    int changes_num = Earley::Close(D, 0, BS);  // adds (T -> .(T), 0) and (T -> .(), 0), returns 2
+    if (changes_num == 2 && D[0].size() == 4
+    && D[0].find(Configuration(2, 0, 0)) != D[0].end()
+    && D[0].find(Configuration(3, 0, 0)) != D[0].end()) {
         std::cout << "Predict test passed.\n";
     } else {
         std::cout << "Predict test failed.\n";
@@ -41,14 +47,18 @@ void TestComplete() {
 
     std::vector<GrammarRule> BS_rules = {
         GrammarRule('S', "(T)T"),
-        GrammarRule('T', "(T)")
+        GrammarRule('T', "(T)"),
+        GrammarRule('T', "")
     };
-    Earley::ConfigTable D(2);
-    D[0].emplace(BS_rules[0], 1, 1);  // (S -> (.T)T, 1)
-    D[1].emplace(BS_rules[1], 3, 2);  // (T -> (T)., 2)
-    int changes_num = Earley::Complete(D, 1);  // adds (S -> (T.)T, 2), returns 1
-    if (changes_num == 1 && D[0].size() == 1 && D[1].size() == 2
-    && D[1].find(Configuration(BS_rules[0], 2, 2)) != D[1].end()) {
+    CompiledGrammar BS(Grammar(BS_rules, 'S'));
+    Earley::ConfigTable D = Earley::MakeTable(BS, 5);
+    D.emplace(1, 0, 1, 0);  // (S -> (.T)T, 0)
+    D.emplace(1, 1, 1, 0);  // (T -> (.T), 0), waits for T too
+    D.emplace(4, 1, 3, 1);  // (T -> (T)., 1)
+    int changes_num = Earley::Close(D, 4, BS);  // adds (S -> (T.)T, 0) and (T -> (T.), 0), returns 2
+    if (changes_num == 2 && D[1].size() == 2 && D[4].size() == 3
+    && D[4].find(Configuration(0, 2, 0)) != D[4].end()
+    && D[4].find(Configuration(1, 2, 0)) != D[4].end()) {
         std::cout << "Complete test passed.\n";
     } else {
         std::cout << "Complete test failed.\n";
@@ -56,6 +66,414 @@ void TestComplete() {
 
 }
 
+void TestNullable() {
+
+    // A and B are nullable only through each other and C, C -> eps is added last
+    std::vector<GrammarRule> rules = {
+        GrammarRule('S', "AaB"),
+        GrammarRule('A', "BC"),
+        GrammarRule('B', "C"),
+        GrammarRule('B', "b"),
+        GrammarRule('C', "")
+    };
+    Grammar grammar(rules, 'S');
+    CompiledGrammar compiled(grammar);
+    int S = compiled.AddNonterminal("S");
+    int A = compiled.AddNonterminal("A");
+    int B = compiled.AddNonterminal("B");
+    int C = compiled.AddNonterminal("C");
+
+    Earley::ConfigTable D = Earley::MakeTable(compiled, 1);
+    D.emplace(0, 0, 0, 0);  // (S -> .AaB, 0)
+    // predicts A, B, C and moves dots over all of them:
+    // (A -> .BC, 0), (A -> B.C, 0), (A -> BC., 0), (B -> .C, 0), (B -> C., 0),
+    // (B -> .b, 0), (C -> ., 0), (S -> A.aB, 0)
+    int changes_num = Earley::Close(D, 0, compiled);
+
+    Algo parser(grammar);
+    if (!compiled.IsNullable(S) && compiled.IsNullable(A) && compiled.IsNullable(B) && compiled.IsNullable(C)
+    && changes_num == 8 && D[0].find(Configuration(0, 1, 0)) != D[0].end()
+    && parser.IsDeducible("a") && parser.IsDeducible("bab") && parser.IsDeducible("ba")
+    && !parser.IsDeducible("") && !parser.IsDeducible("bb")) {
+        std::cout << "Nullable test passed.\n";
+    } else {
+        std::cout << "Nullable test failed.\n";
+    }
+
+}
+
+void TestConfigTable() {
+
+    bool flag = true;
+
+    // S -> S(S) | (S)S: columns are filled in order, duplicates are found
+    CompiledGrammar BS(Grammar({GrammarRule('S', "S(S)"), GrammarRule('S', "(S)S")}, 'S'));
+    Earley::ConfigTable D(BS, 3);
+    flag = flag && D.emplace(0, 0, 0, 0) && D.emplace(0, 1, 1, 0) && !D.emplace(0, 0, 0, 0);
+    flag = flag && D.emplace(2, 1, 2, 0);  // closes columns 0 and 1
+    flag = flag && D[0].size() == 2 && D[1].size() == 0 && D[2].size() == 1;
+    flag = flag && D.Waiting(0, 0).size() == 2 && D.Waiting(1, 0).size() == 0;
+    flag = flag && D[0].find(Configuration(1, 1, 0)) != D[0].end() && D[2].find(Configuration(1, 1, 0)) == D[2].end();
+    D.Truncate(1);
+    flag = flag && D.size() == 1 && D[0].size() == 2;
+
+    // with Leo's optimization columns of S -> aS | a don't grow with the length
+    Algo parser(Grammar({GrammarRule('S', "aS"), GrammarRule('S', "a")}, 'S'));
+    StreamRecognizer stream = parser.Stream();
+    for (int i = 0; i < 1000; ++i) {
+        stream.Feed('a');
+    }
+    const Earley::ConfigTable& table = stream.Table();
+    for (int j = 0; j < table.size(); ++j) {
+        flag = flag && table[j].size() <= 5 && table[j].Bytes() <= 256;
+    }
+    flag = flag && stream.IsAcceptedSoFar() && table.size() == 1001;
+
+    if (flag) {
+        std::cout << "Config table test passed.\n";
+    } else {
+        std::cout << "Config table test failed.\n";
+    }
+
+}
+
+size_t RightRecursionChartSize(const CompiledGrammar& grammar, const std::string& word, bool leo) {
+
+    Earley::ConfigTable D = Earley::MakeTable(grammar, word.length() + 1);
+    D.emplace(0, grammar.StartRule(), 0, 0);
+    size_t chart_size = 0;
+    for (int i = 0; i <= static_cast<int>(word.length()); ++i) {
+        Earley::Scan(D, i - 1, word, grammar);
+        Earley::Close(D, i, grammar, leo);
+        chart_size += D[i].size();
+    }
+    return chart_size;
+
+}
+
+void TestLeo() {
+
+    // S -> aS | a: every column of the classic chart has all (S -> aS., i), i < j
+    CompiledGrammar right_recursive(Grammar({GrammarRule('S', "aS"), GrammarRule('S', "a")}, 'S'));
+    std::string word(200, 'a');
+    size_t leo_size = RightRecursionChartSize(right_recursive, word, true);
+    size_t classic_size = RightRecursionChartSize(right_recursive, word, false);
+
+    // answers must not depend on the optimization
+    Grammar CBS({GrammarRule('S', "(S)S"), GrammarRule('S', "")}, 'S');
+    Algo leo_parser(CBS);
+    Algo classic_parser(CBS);
+    classic_parser.SetLeoOptimization(false);
+    bool same = true;
+    for (const char* CBS_word : {"", "()", "(()())()", "(()", "())(", "((((()))))()"}) {
+        same = same && leo_parser.IsDeducible(CBS_word) == classic_parser.IsDeducible(CBS_word);
+    }
+
+    if (leo_size <= 10 * word.length() && classic_size > word.length() * word.length() / 2 && same) {
+        std::cout << "Leo test passed.\n";
+    } else {
+        std::cout << "Leo test failed.\n";
+    }
+
+}
+
+bool IsLeftmostDerivation(const Grammar& grammar, const std::vector<int>& derivation, const std::string& word) {
+
+    std::string form(1, grammar.start_nonterminal);
+    for (int rule : derivation) {
+        size_t position = 0;
+        while (position < form.length() && !GrammarRule::IsNonterminal(form[position])) {
+            ++position;
+        }
+        if (position == form.length() || form[position] != grammar.rules[rule].from) {
+            return false;
+        }
+        form.replace(position, 1, grammar.rules[rule].to);
+    }
+    return form == word;
+
+}
+
+void TestParse() {
+
+    bool flag = true;
+
+    // S -> SS | a: a^n has Catalan(n - 1) derivations, the forest is still O(n^3)
+    Grammar ambiguous({GrammarRule('S', "SS"), GrammarRule('S', "a")}, 'S');
+    Algo ambiguous_parser(ambiguous);
+    std::string word(12, 'a');
+    Forest forest = ambiguous_parser.Parse(word);
+    std::set<std::vector<int>> derivations;
+    for (Forest::Count k : {Forest::Count(0), Forest::Count(1), Forest::Count(12345), Forest::Count(58785)}) {
+        std::vector<int> derivation = forest.Derivation(k);
+        flag = flag && IsLeftmostDerivation(ambiguous, derivation, word) && derivations.insert(derivation).second;
+    }
+    flag = flag && forest.DerivationsNum() == 58786;
+
+    Forest long_forest = ambiguous_parser.Parse(std::string(60, 'a'));
+    flag = flag && long_forest.DerivationsNum() == Forest::kInfinity  // Catalan(59) doesn't fit
+        && long_forest.PackedNum() <= 60 * 60 * 60
+        && IsLeftmostDerivation(ambiguous, long_forest.Derivation(1000000007), std::string(60, 'a'));
+
+    // iterating derivations of CBS
+    Grammar CBS({GrammarRule('S', "(S)S"), GrammarRule('S', "")}, 'S');
+    Algo CBS_parser(CBS);
+    Forest CBS_forest = CBS_parser.Parse("(()())()");
+    int derivations_num = 0;
+    for (auto it = CBS_forest.begin(); it != CBS_forest.end(); ++it) {
+        flag = flag && IsLeftmostDerivation(CBS, *it, "(()())()");
+        ++derivations_num;
+    }
+    flag = flag && derivations_num == 1 && CBS_parser.Parse("(()").Root() == nullptr;
+
+    // S -> S | a: infinitely many derivations, the first ones are still found
+    Grammar cyclic({GrammarRule('S', "S"), GrammarRule('S', "a")}, 'S');
+    Forest cyclic_forest = Algo(cyclic).Parse("a");
+    flag = flag && cyclic_forest.DerivationsNum() == Forest::kInfinity
+        && cyclic_forest.Derivation(0) == std::vector<int>({1})
+        && cyclic_forest.Derivation(2) == std::vector<int>({0, 0, 1});
+
+    if (flag) {
+        std::cout << "Parse test passed.\n";
+    } else {
+        std::cout << "Parse test failed.\n";
+    }
+
+}
+
+void TestBatch() {
+
+    GrammarRule CBS_rule_1('S', "(S)S");
+    GrammarRule CBS_rule_2('S', "");
+    Algo CBS_parser(Grammar({CBS_rule_1, CBS_rule_2}, 'S'));
+
+    // words with common prefixes, prefixes of each other and repeated words
+    std::vector<std::string> words;
+    std::string word;
+    for (int i = 0; i < 200; ++i) {
+        word.push_back("(()"[i * 7 % 3]);
+        words.push_back(word);
+        words.push_back(word + ")");
+        words.push_back(word.substr(0, i / 2) + "()");
+    }
+    words.push_back("");
+    words.push_back("()");
+
+    std::vector<bool> expected;
+    for (const auto& current : words) {
+        expected.push_back(CBS_parser.IsDeducible(current));
+    }
+
+    if (CBS_parser.AreDeducible(words, 1) == expected && CBS_parser.AreDeducible(words, 4) == expected
+    && CBS_parser.AreDeducible({}).empty()) {
+        std::cout << "Batch test passed.\n";
+    } else {
+        std::cout << "Batch test failed.\n";
+    }
+
+}
+
+void TestStream() {
+
+    bool flag = true;
+
+    // { w: 2 * |w|(a) - |w|(b) = -2 } from 2nd control work
+    std::vector<GrammarRule> G_rules = {
+        GrammarRule('S', "TbTbT"),
+        GrammarRule('T', "aTbTbT"),
+        GrammarRule('T', "bTbTaT"),
+        GrammarRule('T', "bTaTbT"),
+        GrammarRule('T', "")
+    };
+    Algo G_parser(Grammar(G_rules, 'S'));
+    StreamRecognizer stream = G_parser.Stream();
+    std::string word = "abbbbabbbabababbbbab";
+    for (size_t i = 0; i < word.length(); ++i) {
+        flag = flag && stream.IsViablePrefix()
+            && stream.IsAcceptedSoFar() == G_parser.IsDeducible(word.substr(0, i));
+        stream.Feed(word[i]);
+    }
+    flag = flag && stream.IsAcceptedSoFar() && stream.Length() == word.length();
+
+    // the chart dies on the first symbol that isn't a terminal of the grammar
+    stream.Feed('c');
+    flag = flag && !stream.IsViablePrefix() && !stream.IsAcceptedSoFar();
+    stream.Feed('b');
+    flag = flag && !stream.IsViablePrefix() && !stream.IsAcceptedSoFar() && stream.Length() == word.length() + 2;
+
+    // S -> aSb | ab | bU, U has no rules: S -> bU is never predicted, so "b" isn't viable
+    Algo AB_parser(Grammar({GrammarRule('S', "aSb"), GrammarRule('S', "ab"), GrammarRule('S', "bU")}, 'S'));
+    StreamRecognizer AB_stream = AB_parser.Stream();
+    for (char symbol : std::string("aab")) {
+        AB_stream.Feed(symbol);
+    }
+    flag = flag && AB_stream.IsViablePrefix() && !AB_stream.IsAcceptedSoFar();
+    AB_stream.Feed('b');
+    flag = flag && AB_stream.IsAcceptedSoFar();
+    StreamRecognizer B_stream = AB_parser.Stream();
+    B_stream.Feed('b');
+    flag = flag && !B_stream.IsViablePrefix();
+
+    // empty language: nothing is viable
+    Algo empty_parser(Grammar({GrammarRule('S', "aU")}, 'S'));
+    flag = flag && !empty_parser.Stream().IsViablePrefix();
+
+    if (flag) {
+        std::cout << "Stream test passed.\n";
+    } else {
+        std::cout << "Stream test failed.\n";
+    }
+
+}
+
+void TestStats() {
+
+    bool flag = true;
+
+    // S -> SS | a is highly ambiguous: many completions of the same configuration are rejected
+    Algo parser(Grammar({GrammarRule('S', "SS"), GrammarRule('S', "a")}, 'S'));
+    std::string word = "aaaaaaaaaaaa";
+    Earley::Stats stats;
+    flag = flag && parser.IsDeducible(word, stats) && stats.Columns().size() == word.length() + 1;
+
+    // every configuration is counted once, in its column and by its rule
+    StreamRecognizer stream = parser.Stream();
+    for (char symbol : word) {
+        stream.Feed(symbol);
+    }
+    size_t items_num = 0;
+    size_t duplicates_num = 0;
+    for (size_t j = 0; j <= word.length(); ++j) {
+        const Earley::Stats::ColumnStats& column = stats.Columns()[j];
+        size_t column_items = column.items[0] + column.items[1] + column.items[2];
+        flag = flag && column_items == stream.Table()[j].size() && column.rounds > 0
+            && column.probes >= column_items + column.duplicates;
+        flag = flag && (j == 0 || column.items[static_cast<int>(Earley::ItemSource::kScan)] > 0);
+        items_num += column_items;
+        duplicates_num += column.duplicates;
+    }
+    size_t rules_items_num = 0;
+    for (size_t items : stats.ItemsByRule()) {
+        rules_items_num += items;
+    }
+    flag = flag && rules_items_num == items_num && duplicates_num > 0;
+
+    // a rejected word is recorded up to its last column too
+    Earley::Stats rejected_stats;
+    flag = flag && !parser.IsDeducible("aab", rejected_stats) && rejected_stats.Columns().size() == 4;
+
+    std::ostringstream json;
+    rejected_stats.WriteJson(json);
+    flag = flag && json.str().find("{\"columns\": [{\"column\": 0, \"scan\": 0, \"predict\": ") == 0
+        && json.str().find("\"rules\": [{\"rule\": 0, \"items\": ") != std::string::npos;
+
+    if (flag) {
+        std::cout << "Stats test passed.\n";
+    } else {
+        std::cout << "Stats test failed.\n";
+    }
+
+}
+
+void TestCompiledGrammar() {
+
+    // named nonterminals, more of them than letters:
+    // N0 -> a N1 | a, N1 -> a N2 | a, ..., N299 -> a N0 | a, i.e. { a^k: k >= 1 }
+    const int nonterminals_num = 300;
+    CompiledGrammar chain;
+    for (int i = 0; i < nonterminals_num; ++i) {
+        int from = chain.AddNonterminal("N" + std::to_string(i));
+        int to = chain.AddNonterminal("N" + std::to_string((i + 1) % nonterminals_num));
+        chain.AddRule(from, {CompiledGrammar::AddTerminal('a'), to});
+        chain.AddRule(from, {CompiledGrammar::AddTerminal('a')});
+    }
+    chain.SetStart(chain.AddNonterminal("N0"));
+    Algo chain_parser(chain);
+
+    if (chain.NonterminalsNum() == nonterminals_num + 1 && chain.RulesNum() == 2 * nonterminals_num + 1
+    && chain_parser.IsDeducible(std::string(1000, 'a')) && !chain_parser.IsDeducible("")
+    && !chain_parser.IsDeducible("aaab")) {
+        std::cout << "Compiled grammar test passed.\n";
+    } else {
+        std::cout << "Compiled grammar test failed.\n";
+    }
+
+}
+
+void TestCYK() {
+
+    bool flag = true;
+
+    std::vector<Grammar> grammars = {
+        // CBS, eps in the language
+        Grammar({GrammarRule('S', "(S)S"), GrammarRule('S', "")}, 'S'),
+        // grammar from 2nd control work, { w: 2 * |w|(a) - |w|(b) = -2 }, nullable T in long bodies
+        Grammar({
+            GrammarRule('S', "TbTbT"),
+            GrammarRule('T', "aTbTbT"),
+            GrammarRule('T', "bTbTaT"),
+            GrammarRule('T', "bTaTbT"),
+            GrammarRule('T', "")
+        }, 'S'),
+        // BS without a terminating rule, empty language
+        Grammar({GrammarRule('S', "S(S)"), GrammarRule('S', "(S)S")}, 'S'),
+        // unit cycle S -> A -> S and a chain of unit rules to a terminal
+        Grammar({
+            GrammarRule('S', "SS"),
+            GrammarRule('S', "A"),
+            GrammarRule('A', "S"),
+            GrammarRule('A', "B"),
+            GrammarRule('B', "a"),
+            GrammarRule('A', "(A)")
+        }, 'S')
+    };
+
+    for (const auto& grammar : grammars) {
+        Algo parser(grammar);
+        CYK spans(grammar);
+        CYK valiant(grammar);
+        valiant.SetMode(CYK::Mode::kValiant);
+        // every word of length <= 8 over the letters of the grammar
+        std::set<char> letters;
+        for (const auto& rule : grammar.rules) {
+            for (char symbol : rule.to) {
+                if (!GrammarRule::IsNonterminal(symbol)) {
+                    letters.insert(symbol);
+                }
+            }
+        }
+        std::vector<std::string> words = {""};
+        for (size_t i = 0; i < words.size() && words[i].length() < 8; ++i) {
+            for (char letter : letters) {
+                words.push_back(words[i] + letter);
+            }
+        }
+        for (const auto& word : words) {
+            bool expected = parser.IsDeducible(word);
+            flag = flag && spans.IsDeducible(word) == expected && valiant.IsDeducible(word) == expected;
+        }
+    }
+
+    // long words: blocks of Valiant's algorithm are big enough for several threads
+    CYK G_valiant(grammars[1]);
+    G_valiant.SetMode(CYK::Mode::kValiant);
+    G_valiant.SetThreadsNum(4);
+    CYK G_spans(grammars[1]);
+    std::string G_word;
+    for (int i = 0; i < 100; ++i) {
+        G_word += "abbabb";
+    }
+    flag = flag && G_valiant.IsDeducible(G_word + "bb") && G_spans.IsDeducible(G_word + "bb");
+    flag = flag && !G_valiant.IsDeducible(G_word + "b") && !G_spans.IsDeducible(G_word + "b");
+
+    if (flag) {
+        std::cout << "CYK test passed.\n";
+    } else {
+        std::cout << "CYK test failed.\n";
+    }
+
+}
+
 void TestAlgo() {
 
     bool flag = true;
@@ -110,6 +528,15 @@ int main() {
     TestScan();
     TestPredict();
     TestComplete();
+    TestNullable();
+    TestConfigTable();
+    TestLeo();
+    TestParse();
+    TestBatch();
+    TestStream();
+    TestStats();
+    TestCompiledGrammar();
+    TestCYK();
     TestAlgo();
     return 0;
 }